@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "blockdev.h"
+#include "../include/macros.h"
+
+/**
+ * @brief      Helper to get the byte position of an offset within a block in the image
+ *
+ * @param      fat     The FAT filesystem
+ * @param[in]  block   The block
+ * @param[in]  offset  The byte offset within block
+ *
+ * @return     The byte position in the image
+ */
+off_t blockPosition(fat *fat, uint16_t block, uint32_t offset) {
+    return (off_t) fat->numBlocks * fat->blockSize + (off_t) (block - 1) * fat->blockSize + offset;
+}
+
+/**
+ * @brief      Helper to read bytes of the image with pread, retrying in case of short reads. Reading past the end of
+ *             the image only happens for never-written blocks, so those bytes read as zeros
+ *
+ * @param      fat     The FAT filesystem
+ * @param[in]  pos     The byte position in the image to read from
+ * @param      buf     The buffer to read into
+ * @param[in]  length  The number of bytes to read
+ *
+ * @return     SUCCESS on success, FAILURE if pread fails
+ */
+int readDevice(fat *fat, off_t pos, uint8_t *buf, uint32_t length) {
+    uint32_t done = 0;
+    while (done < length) {
+        ssize_t res = pread(fat->fd, &buf[done], length - done, pos + done);
+
+        if (res == -1) {
+            perror("pread");
+            return FAILURE;
+        }
+
+        if (res == 0) {
+            memset(&buf[done], 0, length - done);
+            break;
+        }
+
+        done += res;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief      Helper to write bytes of the image with pwrite, retrying in case of short writes
+ *
+ * @param      fat     The FAT filesystem
+ * @param[in]  pos     The byte position in the image to write to
+ * @param      buf     The bytes to write
+ * @param[in]  length  The number of bytes to write
+ *
+ * @return     SUCCESS on success, FAILURE if pwrite fails
+ */
+int writeDevice(fat *fat, off_t pos, uint8_t *buf, uint32_t length) {
+    uint32_t done = 0;
+    while (done < length) {
+        ssize_t res = pwrite(fat->fd, &buf[done], length - done, pos + done);
+
+        if (res == -1) {
+            perror("pwrite");
+            return FAILURE;
+        }
+
+        done += res;
+    }
+
+    return SUCCESS;
+}
+
+blockCache *newBlockCache(uint32_t capacity, fat *fat) {
+    blockCache *cache = malloc(sizeof(blockCache));
+    if (cache == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    cache->capacity = capacity;
+    cache->used = 0;
+    cache->hand = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->writebacks = 0;
+
+    cache->slots = malloc(capacity * sizeof(cacheSlot));
+    cache->data = malloc((size_t) capacity * fat->blockSize);
+    cache->slotOf = calloc(fat->numEntries, sizeof(uint32_t));
+
+    if (cache->slots == NULL || cache->data == NULL || cache->slotOf == NULL) {
+        perror("malloc");
+        freeBlockCache(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void freeBlockCache(blockCache *cache) {
+    if (cache == NULL)
+        return;
+
+    free(cache->slots);
+    free(cache->data);
+    free(cache->slotOf);
+    free(cache);
+}
+
+/**
+ * @brief      Helper to get the contents of a cache slot
+ *
+ * @param      fat   The FAT filesystem
+ * @param[in]  slot  The slot
+ *
+ * @return     Pointer to the blockSize bytes cached in the slot
+ */
+uint8_t *slotData(fat *fat, uint32_t slot) {
+    return &fat->cache->data[(size_t) slot * fat->blockSize];
+}
+
+/**
+ * @brief      Helper to write a cache slot back to the image if it is dirty
+ *
+ * @param      fat   The FAT filesystem
+ * @param[in]  slot  The slot
+ *
+ * @return     SUCCESS on success, FAILURE if pwrite fails
+ */
+int writeBackSlot(fat *fat, uint32_t slot) {
+    cacheSlot *cached = &fat->cache->slots[slot];
+    if (!cached->dirty)
+        return SUCCESS;
+
+    if (writeDevice(fat, blockPosition(fat, cached->block, 0), slotData(fat, slot), fat->blockSize) == FAILURE)
+        return FAILURE;
+
+    cached->dirty = false;
+    fat->cache->writebacks++;
+
+    return SUCCESS;
+}
+
+/**
+ * @brief      Helper to take a cache slot for a block. When the cache is full, the clock hand sweeps past recently
+ *             referenced slots (clearing their reference bit) and evicts the first unreferenced one, writing it back
+ *             if it is dirty
+ *
+ * @param      fat    The FAT filesystem
+ * @param[in]  block  The block to cache, its contents are left for the caller to fill in
+ *
+ * @return     The slot now caching block, -1 if writing back the evicted block fails
+ */
+int claimSlot(fat *fat, uint16_t block) {
+    blockCache *cache = fat->cache;
+    uint32_t slot;
+
+    if (cache->used < cache->capacity) {
+        slot = cache->used++;
+    } else {
+        while (cache->slots[cache->hand].referenced) {
+            cache->slots[cache->hand].referenced = false;
+            cache->hand = (cache->hand + 1) % cache->capacity;
+        }
+
+        slot = cache->hand;
+        cache->hand = (cache->hand + 1) % cache->capacity;
+
+        if (writeBackSlot(fat, slot) == FAILURE)
+            return -1;
+
+        // only unmap the evicted block if the slot still holds it (see releaseSlot)
+        uint16_t evicted = cache->slots[slot].block;
+        if (cache->slotOf[evicted] == slot + 1)
+            cache->slotOf[evicted] = 0;
+    }
+
+    cache->slots[slot].block = block;
+    cache->slots[slot].dirty = false;
+    cache->slots[slot].referenced = true;
+    cache->slotOf[block] = slot + 1;
+
+    return slot;
+}
+
+/**
+ * @brief      Helper to forget a block whose slot could not be filled in, leaving the slot to be reused
+ *
+ * @param      fat    The FAT filesystem
+ * @param[in]  block  The block
+ */
+void releaseSlot(fat *fat, uint16_t block) {
+    fat->cache->slotOf[block] = 0;
+}
+
+/**
+ * @brief      Helper to check whether a transfer covers so many blocks that its uncached blocks should go straight to
+ *             the image, so that streaming a large file does not evict everything else from the cache
+ *
+ * @param      fat     The FAT filesystem
+ * @param[in]  offset  The byte offset within the first block
+ * @param[in]  length  The number of bytes transferred
+ *
+ * @return     Whether uncached blocks should bypass the cache
+ */
+bool isStreaming(fat *fat, uint32_t offset, uint32_t length) {
+    uint32_t blocks = (offset + length + fat->blockSize - 1) / fat->blockSize;
+    return blocks > fat->cache->capacity / 2;
+}
+
+int readBlocks(fat *fat, uint16_t block, uint32_t offset, uint8_t *buf, uint32_t length) {
+    // copy straight out of the mapping when the whole image is mapped
+    if (fat->image != NULL) {
+        memcpy(buf, &fat->image[blockPosition(fat, block, offset)], length);
+        return SUCCESS;
+    }
+
+    blockCache *cache = fat->cache;
+    if (cache == NULL)
+        return readDevice(fat, blockPosition(fat, block, offset), buf, length);
+
+    bool streaming = isStreaming(fat, offset, length);
+
+    // consecutive uncached blocks of a streaming read are gathered into one pread
+    off_t runPos = 0;
+    uint32_t runStart = 0;
+    uint32_t runBytes = 0;
+
+    uint32_t done = 0;
+    while (done < length) {
+        uint32_t chunk = fat->blockSize - offset;
+        if (chunk > length - done)
+            chunk = length - done;
+
+        int slot = (int) cache->slotOf[block] - 1;
+        if (slot == -1 && streaming) {
+            cache->misses++;
+            if (runBytes == 0) {
+                runPos = blockPosition(fat, block, offset);
+                runStart = done;
+            }
+            runBytes += chunk;
+        } else {
+            if (runBytes != 0) {
+                if (readDevice(fat, runPos, &buf[runStart], runBytes) == FAILURE)
+                    return FAILURE;
+                runBytes = 0;
+            }
+
+            if (slot == -1) {
+                // load the whole block into the cache
+                cache->misses++;
+                if ((slot = claimSlot(fat, block)) == -1)
+                    return FAILURE;
+
+                if (readDevice(fat, blockPosition(fat, block, 0), slotData(fat, slot), fat->blockSize) == FAILURE) {
+                    releaseSlot(fat, block);
+                    return FAILURE;
+                }
+            } else {
+                cache->hits++;
+            }
+
+            cache->slots[slot].referenced = true;
+            memcpy(&buf[done], &slotData(fat, slot)[offset], chunk);
+        }
+
+        done += chunk;
+        block++;
+        offset = 0;
+    }
+
+    if (runBytes != 0)
+        return readDevice(fat, runPos, &buf[runStart], runBytes);
+
+    return SUCCESS;
+}
+
+int writeBlocks(fat *fat, uint16_t block, uint32_t offset, uint8_t *buf, uint32_t length) {
+    // copy straight into the mapping when the whole image is mapped
+    if (fat->image != NULL) {
+        memcpy(&fat->image[blockPosition(fat, block, offset)], buf, length);
+        return SUCCESS;
+    }
+
+    blockCache *cache = fat->cache;
+    if (cache == NULL)
+        return writeDevice(fat, blockPosition(fat, block, offset), buf, length);
+
+    bool streaming = isStreaming(fat, offset, length);
+
+    // consecutive uncached blocks of a streaming write are gathered into one pwrite
+    off_t runPos = 0;
+    uint32_t runStart = 0;
+    uint32_t runBytes = 0;
+
+    uint32_t done = 0;
+    while (done < length) {
+        uint32_t chunk = fat->blockSize - offset;
+        if (chunk > length - done)
+            chunk = length - done;
+
+        int slot = (int) cache->slotOf[block] - 1;
+        if (slot == -1 && streaming) {
+            cache->misses++;
+            if (runBytes == 0) {
+                runPos = blockPosition(fat, block, offset);
+                runStart = done;
+            }
+            runBytes += chunk;
+        } else {
+            if (runBytes != 0) {
+                if (writeDevice(fat, runPos, &buf[runStart], runBytes) == FAILURE)
+                    return FAILURE;
+                runBytes = 0;
+            }
+
+            if (slot == -1) {
+                cache->misses++;
+                if ((slot = claimSlot(fat, block)) == -1)
+                    return FAILURE;
+
+                // a partially written block needs the rest of its contents from the image
+                if (chunk < fat->blockSize
+                    && readDevice(fat, blockPosition(fat, block, 0), slotData(fat, slot), fat->blockSize) == FAILURE) {
+                    releaseSlot(fat, block);
+                    return FAILURE;
+                }
+            } else {
+                cache->hits++;
+            }
+
+            // leave the block dirty in the cache, it is written back on eviction or flush
+            cache->slots[slot].referenced = true;
+            cache->slots[slot].dirty = true;
+            memcpy(&slotData(fat, slot)[offset], &buf[done], chunk);
+        }
+
+        done += chunk;
+        block++;
+        offset = 0;
+    }
+
+    if (runBytes != 0)
+        return writeDevice(fat, runPos, &buf[runStart], runBytes);
+
+    return SUCCESS;
+}
+
+int flushBlockCache(fat *fat) {
+    if (fat->cache == NULL)
+        return SUCCESS;
+
+    for (uint32_t slot = 0; slot < fat->cache->used; slot++) {
+        if (writeBackSlot(fat, slot) == FAILURE)
+            return FAILURE;
+    }
+
+    return SUCCESS;
+}
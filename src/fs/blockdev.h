@@ -0,0 +1,115 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fat.h"
+
+/**
+ * @file blockdev.h
+ * @brief Block device layer for the data region of a mounted PennFAT image, all reads and writes of file data go
+ * through here using the image descriptor kept in the FAT (or the mapping when the whole image is mapped)
+ */
+
+// Number of data blocks kept in the write-back block cache, override with -DBLOCK_CACHE_SIZE=n in CPPFLAGS (0 disables
+// the cache). The cache is not used when the whole image is mapped, since the mapping is already backed by memory
+#ifndef BLOCK_CACHE_SIZE
+#define BLOCK_CACHE_SIZE 64
+#endif
+
+/**
+ * A slot of the block cache holding the contents of one data block
+ */
+typedef struct cacheSlotType {
+    // index in the FAT of the cached block
+    uint16_t block;
+
+    // whether the cached contents are newer than the image on disk
+    bool dirty;
+
+    // whether the block was used since the clock hand last passed this slot
+    bool referenced;
+} cacheSlot;
+
+/**
+ * Bounded write-back cache of data blocks, evicting with the CLOCK algorithm
+ */
+typedef struct blockCacheType {
+    // Number of slots in the cache
+    uint32_t capacity;
+
+    // Number of slots holding a block
+    uint32_t used;
+
+    // Slot the clock hand points at
+    uint32_t hand;
+
+    // Slot metadata, and the contents of every slot (capacity * blockSize bytes)
+    cacheSlot *slots;
+    uint8_t *data;
+
+    // For every block in the FAT, the slot caching it plus one, 0 if the block is not cached
+    uint32_t *slotOf;
+
+    // Statistics: lookups that found the block, lookups that did not, and dirty blocks written to disk
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writebacks;
+} blockCache;
+
+/**
+ * @brief      Creates an empty block cache for a FAT
+ *
+ * @param[in]  capacity  The number of blocks to cache
+ * @param      fat       The FAT filesystem
+ *
+ * @return     A pointer to the new block cache, NULL if malloc fails
+ */
+blockCache *newBlockCache(uint32_t capacity, fat *fat);
+
+/**
+ * @brief      Writes every dirty block in the FAT's block cache back to the image
+ *
+ * @param      fat   The FAT filesystem
+ *
+ * @return     SUCCESS on success (or when there is no cache), FAILURE if pwrite fails
+ */
+int flushBlockCache(fat *fat);
+
+/**
+ * @brief      Frees a block cache, without writing back its dirty blocks
+ *
+ * @param      cache  The block cache
+ */
+void freeBlockCache(blockCache *cache);
+
+/**
+ * @brief      Reads bytes from the data region, starting at an offset within a block and continuing into the
+ *             physically following blocks. Bytes that were never written read as zeros
+ *
+ * @param      fat     The FAT filesystem
+ * @param[in]  block   The block to start reading at
+ * @param[in]  offset  The byte offset within block to start reading at
+ * @param      buf     The buffer to read into
+ * @param[in]  length  The number of bytes to read
+ *
+ * @return     SUCCESS on success, FAILURE if pread fails
+ */
+int readBlocks(fat *fat, uint16_t block, uint32_t offset, uint8_t *buf, uint32_t length);
+
+/**
+ * @brief      Writes bytes to the data region, starting at an offset within a block and continuing into the
+ *             physically following blocks. With the block cache enabled, the bytes may only reach the image at the
+ *             next flushBlockCache
+ *
+ * @param      fat     The FAT filesystem
+ * @param[in]  block   The block to start writing at
+ * @param[in]  offset  The byte offset within block to start writing at
+ * @param      buf     The bytes to write
+ * @param[in]  length  The number of bytes to write
+ *
+ * @return     SUCCESS on success, FAILURE if pwrite fails
+ */
+int writeBlocks(fat *fat, uint16_t block, uint32_t offset, uint8_t *buf, uint32_t length);
+
+#endif
@@ -9,19 +9,79 @@
 
 #include "fat.h"
 #include "file.h"
+#include "blockdev.h"
 #include "../include/macros.h"
 
+/**
+ * @brief      Helper to allocate a slab of directory entry nodes for a FAT, with every node pointing at its entry
+ *
+ * @param[in]  count  The number of nodes in the slab
+ * @param      fat    The FAT
+ *
+ * @return     The new slab, already linked into the FAT's slabs, NULL on failed malloc
+ */
+directoryEntrySlab *newDirectoryEntrySlab(uint32_t count, fat *fat) {
+    // one allocation holds the slab, its nodes and then its entries
+    directoryEntrySlab *slab = malloc(sizeof(directoryEntrySlab) + count * (sizeof(directoryEntryNode) + sizeof(directoryEntry)));
+    if (slab == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    slab->count = count;
+    slab->nodes = (directoryEntryNode *) &slab[1];
+    slab->entries = (directoryEntry *) &slab->nodes[count];
+
+    for (uint32_t i = 0; i < count; i++) {
+        slab->nodes[i].entry = &slab->entries[i];
+        slab->nodes[i].openFiles = NULL;
+    }
+
+    slab->next = fat->slabs;
+    fat->slabs = slab;
+
+    return slab;
+}
+
+/**
+ * @brief      Helper to put the nodes of a slab starting at some index on the FAT's list of unused nodes
+ *
+ * @param      slab  The slab
+ * @param[in]  from  The index of the first unused node
+ * @param      fat   The FAT
+ */
+void releaseSlabNodes(directoryEntrySlab *slab, uint32_t from, fat *fat) {
+    for (uint32_t i = from; i < slab->count; i++) {
+        slab->nodes[i].next = fat->freeNodes;
+        fat->freeNodes = &slab->nodes[i];
+    }
+}
+
 directoryEntryNode *newDirectoryEntryNode(
     char *fileName,
     uint32_t size,
     uint16_t firstBlock,
     uint8_t type,
     uint8_t perm,
-    time_t time
+    time_t time,
+    fat *fat
 ) {
-    directoryEntryNode *outputNode = malloc(sizeof(directoryEntryNode));
-    outputNode->entry = malloc(sizeof(directoryEntry));
+    // take a new slab when every node is in use
+    if (fat->freeNodes == NULL) {
+        directoryEntrySlab *slab = newDirectoryEntrySlab(DIRECTORY_SLAB_SIZE, fat);
+        if (slab == NULL)
+            return NULL;
+        releaseSlabNodes(slab, 0, fat);
+    }
+
+    directoryEntryNode *outputNode = fat->freeNodes;
+    fat->freeNodes = outputNode->next;
+
     outputNode->next = NULL;
+    outputNode->prev = NULL;
+    outputNode->nextInBucket = NULL;
+    outputNode->slot = 0;
+    outputNode->openFiles = NULL;
     directoryEntry *entry = outputNode->entry;
     entry->size = size;
     entry->firstBlock = firstBlock;
@@ -40,9 +100,418 @@ directoryEntryNode *newDirectoryEntryNode(
     return outputNode;
 }
 
-void freeDirectoryEntryNode(directoryEntryNode *node) {
-    free(node->entry);
-    free(node);
+void freeDirectoryEntryNode(directoryEntryNode *node, fat *fat) {
+    node->next = fat->freeNodes;
+    fat->freeNodes = node;
+}
+
+/**
+ * @brief      Helper to hash a file name (FNV-1a over at most the 32 bytes of a directory entry name)
+ *
+ * @param      fileName  The file name
+ *
+ * @return     The hash of the file name
+ */
+uint32_t hashFileName(char *fileName) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 32 && fileName[i] != '\0'; i++) {
+        hash ^= (uint8_t) fileName[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief      Helper to get the name index bucket that a file name belongs in
+ *
+ * @param      fileName  The file name
+ * @param      fat       The FAT
+ *
+ * @return     Pointer to the head of the bucket
+ */
+directoryEntryNode **getNameBucket(char *fileName, fat *fat) {
+    return &fat->nameIndex[hashFileName(fileName) & (fat->nameIndexSize - 1)];
+}
+
+/**
+ * @brief      Helper to unlink a directory entry node from its name index bucket
+ *
+ * @param      node  The directory entry node
+ * @param      fat   The FAT
+ */
+void unindexDirectoryEntryNode(directoryEntryNode *node, fat *fat) {
+    directoryEntryNode **link = getNameBucket(node->entry->name, fat);
+    while (*link != NULL && *link != node)
+        link = &(*link)->nextInBucket;
+
+    if (*link != NULL)
+        *link = node->nextInBucket;
+    node->nextInBucket = NULL;
+}
+
+/**
+ * @brief      Helper to resize the name index to a number of buckets and rehash every directory entry node into it
+ *
+ * @param[in]  size  The new number of buckets, a power of two
+ * @param      fat   The FAT
+ *
+ * @return     SUCCESS on success, FAILURE on failed malloc
+ */
+int resizeNameIndex(uint32_t size, fat *fat) {
+    directoryEntryNode **nameIndex = calloc(size, sizeof(directoryEntryNode *));
+    if (nameIndex == NULL) {
+        perror("calloc");
+        return FAILURE;
+    }
+
+    free(fat->nameIndex);
+    fat->nameIndex = nameIndex;
+    fat->nameIndexSize = size;
+
+    for (directoryEntryNode *node = fat->firstDirectoryEntryNode; node != NULL; node = node->next) {
+        directoryEntryNode **bucket = getNameBucket(node->entry->name, fat);
+        node->nextInBucket = *bucket;
+        *bucket = node;
+    }
+
+    return SUCCESS;
+}
+
+directoryEntryNode *findDirectoryEntryNode(char *fileName, fat *fat) {
+    if (fileName == NULL || fat->nameIndex == NULL)
+        return NULL;
+
+    directoryEntryNode *node = *getNameBucket(fileName, fat);
+    while (node != NULL && strncmp(node->entry->name, fileName, sizeof(node->entry->name)) != 0)
+        node = node->nextInBucket;
+
+    return node;
+}
+
+/**
+ * @brief      Helper to set or clear the dirty bit of a slot
+ *
+ * @param[in]  slot   The slot
+ * @param[in]  dirty  Whether the slot's record changed since the directory file was last written
+ * @param      fat    The FAT
+ */
+void setSlotDirty(uint32_t slot, bool dirty, fat *fat) {
+    if (dirty)
+        fat->dirtySlots[slot / 64] |= 1ULL << (slot % 64);
+    else
+        fat->dirtySlots[slot / 64] &= ~(1ULL << (slot % 64));
+}
+
+/**
+ * @brief      Helper to double the number of slots the FAT can track
+ *
+ * @param      fat   The FAT
+ *
+ * @return     SUCCESS on success, FAILURE on failed realloc
+ */
+int growSlots(fat *fat) {
+    uint32_t capacity = fat->slotCapacity == 0 ? DIRECTORY_SLOTS_MIN_SIZE : fat->slotCapacity * 2;
+
+    directoryEntryNode **slotNodes = realloc(fat->slotNodes, capacity * sizeof(directoryEntryNode *));
+    if (slotNodes == NULL) {
+        perror("realloc");
+        return FAILURE;
+    }
+    fat->slotNodes = slotNodes;
+
+    uint64_t *dirtySlots = realloc(fat->dirtySlots, capacity / 64 * sizeof(uint64_t));
+    if (dirtySlots == NULL) {
+        perror("realloc");
+        return FAILURE;
+    }
+    memset(&dirtySlots[fat->slotCapacity / 64], 0, (capacity - fat->slotCapacity) / 64 * sizeof(uint64_t));
+    fat->dirtySlots = dirtySlots;
+
+    fat->slotCapacity = capacity;
+
+    return SUCCESS;
+}
+
+void markDirectoryEntryDirty(directoryEntryNode *node, fat *fat) {
+    setSlotDirty(node->slot, true, fat);
+}
+
+int appendDirectoryEntryNode(directoryEntryNode *node, fat *fat) {
+    // keep at most one node per bucket on average
+    if (fat->fileCount + 1 > fat->nameIndexSize) {
+        uint32_t size = fat->nameIndexSize == 0 ? NAME_INDEX_MIN_SIZE : fat->nameIndexSize * 2;
+        if (resizeNameIndex(size, fat) == FAILURE)
+            return FAILURE;
+    }
+
+    // the new entry takes the slot after the last record
+    if (fat->fileCount == fat->slotCapacity && growSlots(fat) == FAILURE)
+        return FAILURE;
+    node->slot = fat->fileCount;
+    fat->slotNodes[node->slot] = node;
+    setSlotDirty(node->slot, true, fat);
+
+    // add node to the end of the list
+    node->next = NULL;
+    node->prev = fat->lastDirectoryEntryNode;
+    if (fat->lastDirectoryEntryNode == NULL)
+        fat->firstDirectoryEntryNode = node;
+    else
+        fat->lastDirectoryEntryNode->next = node;
+    fat->lastDirectoryEntryNode = node;
+
+    // add node to the front of its bucket
+    directoryEntryNode **bucket = getNameBucket(node->entry->name, fat);
+    node->nextInBucket = *bucket;
+    *bucket = node;
+
+    fat->fileCount++;
+
+    return SUCCESS;
+}
+
+void removeDirectoryEntryNode(directoryEntryNode *node, fat *fat) {
+    unindexDirectoryEntryNode(node, fat);
+
+    // take the last node off the end of the list, its slot is going away
+    directoryEntryNode *last = fat->lastDirectoryEntryNode;
+    setSlotDirty(last->slot, false, fat);
+
+    fat->lastDirectoryEntryNode = last->prev;
+    if (last->prev == NULL)
+        fat->firstDirectoryEntryNode = NULL;
+    else
+        last->prev->next = NULL;
+
+    // move the last node into the removed node's place in the list and in the directory file
+    if (last != node) {
+        last->prev = node->prev;
+        last->next = node->next;
+
+        if (node->prev == NULL)
+            fat->firstDirectoryEntryNode = last;
+        else
+            node->prev->next = last;
+
+        if (node->next == NULL)
+            fat->lastDirectoryEntryNode = last;
+        else
+            node->next->prev = last;
+
+        last->slot = node->slot;
+        fat->slotNodes[last->slot] = last;
+        setSlotDirty(last->slot, true, fat);
+    }
+
+    node->next = NULL;
+    node->prev = NULL;
+
+    fat->fileCount--;
+}
+
+void renameDirectoryEntryNode(directoryEntryNode *node, char *newFileName, fat *fat) {
+    unindexDirectoryEntryNode(node, fat);
+
+    strcpy(node->entry->name, newFileName);
+    setSlotDirty(node->slot, true, fat);
+
+    directoryEntryNode **bucket = getNameBucket(node->entry->name, fat);
+    node->nextInBucket = *bucket;
+    *bucket = node;
+}
+
+/**
+ * @brief      Helper to check whether a block is free according to the free map
+ *
+ * @param[in]  block  The block
+ * @param      fat    The FAT
+ *
+ * @return     true if the block is free
+ */
+bool isBlockFree(uint32_t block, fat *fat) {
+    if (block >= fat->numEntries)
+        return false;
+
+    return (fat->freeMap[block / 64] >> (block % 64)) & 1;
+}
+
+/**
+ * @brief      Helper to find the first free block at or after some block, wrapping around to the start of the FAT
+ *
+ * @param[in]  from  The block to start searching from
+ * @param      fat   The FAT
+ *
+ * @return     The index of a free block, or 0 if there are none
+ */
+uint16_t findFreeBlock(uint32_t from, fat *fat) {
+    uint32_t numWords = (fat->numEntries + 63) / 64;
+
+    if (from >= fat->numEntries)
+        from = 0;
+
+    // check a word of the map at a time, ignoring the bits before from in the first word
+    uint32_t word = from / 64;
+    uint64_t bits = fat->freeMap[word] & (~0ULL << (from % 64));
+
+    for (uint32_t i = 0; i <= numWords; i++) {
+        if (bits != 0)
+            return word * 64 + __builtin_ctzll(bits);
+
+        word = (word + 1) % numWords;
+        bits = fat->freeMap[word];
+    }
+
+    return 0;
+}
+
+/**
+ * @brief      Helper to build the free map and free block count from the block links
+ *
+ * @param      fat   The FAT
+ *
+ * @return     SUCCESS on success, FAILURE on failed malloc
+ */
+int buildFreeMap(fat *fat) {
+    uint32_t numWords = (fat->numEntries + 63) / 64;
+
+    fat->freeMap = calloc(numWords, sizeof(uint64_t));
+
+    if (fat->freeMap == NULL) {
+        perror("calloc");
+        return FAILURE;
+    }
+
+    fat->freeBlocks = 0;
+    fat->freeHint = 2;
+
+    // block 0 holds FAT metadata, block 1 is the root directory, and 0xFFFF is the end of chain marker
+    for (uint32_t i = 2; i < fat->numEntries && i < 0xFFFF; i++) {
+        if (fat->blocks[i] == 0) {
+            fat->freeMap[i / 64] |= 1ULL << (i % 64);
+            fat->freeBlocks++;
+        }
+    }
+
+    return SUCCESS;
+}
+
+uint16_t allocateBlock(uint16_t prev, fat *fat) {
+    uint16_t found = 0;
+
+    // keep the chain contiguous when the block right after prev is free, otherwise continue from the last allocation
+    if (prev != 0 && isBlockFree(prev + 1, fat))
+        found = prev + 1;
+    else
+        found = findFreeBlock(fat->freeHint, fat);
+
+    if (found == 0)
+        return 0;
+
+    // mark the block as used and the end of its chain
+    fat->freeMap[found / 64] &= ~(1ULL << (found % 64));
+    fat->freeBlocks--;
+    fat->freeHint = found + 1;
+
+    fat->blocks[found] = 0xFFFF;
+    if (prev != 0)
+        fat->blocks[prev] = found;
+
+    return found;
+}
+
+/**
+ * @brief      Helper to find a run of consecutive free blocks at or after some block, wrapping around to the start of
+ *             the FAT (runs themselves never wrap). Only FREE_RUN_SEARCH_LIMIT blocks are looked at, so a fragmented
+ *             FAT costs a bounded search rather than a scan of the whole table
+ *
+ * @param[in]  from   The block to start searching from
+ * @param[in]  count  The length of the run to find
+ * @param      fat    The FAT
+ *
+ * @return     The first block of the run, or 0 if there is no run that long within the search limit
+ */
+uint16_t findFreeRun(uint32_t from, uint32_t count, fat *fat) {
+    uint32_t runStart = 0;
+    uint32_t runLength = 0;
+    uint32_t limit = fat->numEntries < FREE_RUN_SEARCH_LIMIT ? fat->numEntries : FREE_RUN_SEARCH_LIMIT;
+
+    // a run longer than the search window can never be found in it
+    if (count > limit)
+        return 0;
+
+    for (uint32_t i = 0; i < limit; i++) {
+        uint32_t block = (from + i) % fat->numEntries;
+
+        if (block == 0)
+            runLength = 0;
+
+        // skip whole words of the map without any free blocks
+        if (block % 64 == 0 && fat->freeMap[block / 64] == 0) {
+            runLength = 0;
+            i += 63;
+            continue;
+        }
+
+        if (!isBlockFree(block, fat)) {
+            runLength = 0;
+            continue;
+        }
+
+        if (runLength == 0)
+            runStart = block;
+
+        if (++runLength == count)
+            return runStart;
+    }
+
+    return 0;
+}
+
+uint16_t allocateBlocks(uint16_t prev, uint32_t count, fat *fat) {
+    if (count == 0 || count > fat->freeBlocks)
+        return 0;
+
+    // unless the chain can keep growing in place, start the extent at a free run long enough for all of it
+    // near the free hint, otherwise fall back to taking blocks one at a time
+    uint16_t first;
+    if (count > 1 && (prev == 0 || !isBlockFree(prev + 1, fat))) {
+        uint16_t runStart = findFreeRun(fat->freeHint, count, fat);
+        if (runStart != 0) {
+            fat->freeHint = runStart;
+            first = allocateBlock(0, fat);
+            if (prev != 0)
+                fat->blocks[prev] = first;
+        } else {
+            first = allocateBlock(prev, fat);
+        }
+    } else {
+        first = allocateBlock(prev, fat);
+    }
+
+    // every following block prefers the one right after the block before it
+    uint16_t last = first;
+    for (uint32_t i = 1; i < count && last != 0; i++)
+        last = allocateBlock(last, fat);
+
+    if (last == 0)
+        return 0;
+
+    return first;
+}
+
+void freeBlock(uint16_t block, fat *fat) {
+    // a bad chain link must never clear the FAT header or write past the table
+    if (block < 2 || block >= fat->numEntries || block == 0xFFFF)
+        return;
+
+    fat->blocks[block] = 0;
+
+    if (isBlockFree(block, fat))
+        return;
+
+    fat->freeMap[block / 64] |= 1ULL << (block % 64);
+    fat->freeBlocks++;
 }
 
 fat *getFat(char *fileName, uint8_t numBlocks, uint8_t blockSizeIndicator, bool creating) {
@@ -93,9 +562,18 @@ fat *getFat(char *fileName, uint8_t numBlocks, uint8_t blockSizeIndicator, bool
     output->fileCount = 0;
     output->firstDirectoryEntryNode = NULL;
     output->lastDirectoryEntryNode = NULL;
-
-    // set free space equal to total space
-    output->freeBlocks = output->numEntries - 2;
+    output->nameIndex = NULL;
+    output->nameIndexSize = 0;
+    output->slotNodes = NULL;
+    output->slotCapacity = 0;
+    output->dirtySlots = NULL;
+    output->persistedCount = 0;
+    output->slabs = NULL;
+    output->freeNodes = NULL;
+    output->freeMap = NULL;
+    output->image = NULL;
+    output->fd = -1;
+    output->cache = NULL;
 
     // open the file to write to and check for errors
     int fd;
@@ -119,19 +597,51 @@ fat *getFat(char *fileName, uint8_t numBlocks, uint8_t blockSizeIndicator, bool
         }
     }
     
-    // map FAT table in memory to disk
-    output->blocks = mmap(NULL, output->numBlocks * output->blockSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // map FAT table in memory to disk, along with the data region if mapping the whole image
+    uint32_t fatSize = output->numBlocks * output->blockSize;
+    output->mappedSize = fatSize;
+    if (FAT_MAP_IMAGE) {
+        // the data region ends after the last usable block, 0xFFFF marks the end of a chain
+        uint32_t lastBlock = output->numEntries - 1 < 0xFFFE ? output->numEntries - 1 : 0xFFFE;
+        output->mappedSize = fatSize + (size_t) lastBlock * output->blockSize;
+
+        // grow the image so that every block is backed by the file, never-written blocks stay sparse
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            perror("fstat");
+            close(fd);
+            return NULL;
+        }
+
+        if (st.st_size < output->mappedSize && ftruncate(fd, output->mappedSize) == -1) {
+            perror("ftruncate");
+            close(fd);
+            return NULL;
+        }
+    }
+
+    void *mapping = mmap(NULL, output->mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 
     // check if mmap failed
-    if (output->blocks == MAP_FAILED) {
+    if (mapping == MAP_FAILED) {
         perror("mmap");
+        close(fd);
         return NULL;
     }
 
-    // close fd
-    if (close(fd) == -1) {
-        perror("close");
-        return NULL;
+    output->blocks = mapping;
+    if (FAT_MAP_IMAGE)
+        output->image = mapping;
+
+    // keep the descriptor open for reading and writing the data region
+    output->fd = fd;
+
+    // cache data blocks in memory unless the mapping already does
+    if (output->image == NULL && BLOCK_CACHE_SIZE > 0) {
+        if ((output->cache = newBlockCache(BLOCK_CACHE_SIZE, output)) == NULL) {
+            freeFat(&output);
+            return NULL;
+        }
     }
 
     // set first block to store FAT metadata
@@ -141,81 +651,50 @@ fat *getFat(char *fileName, uint8_t numBlocks, uint8_t blockSizeIndicator, bool
     if (output->blocks[1] == 0x0000)
         output->blocks[1] = 0xFFFF;
 
+    // track free space from the block links
+    if (buildFreeMap(output) == FAILURE) {
+        freeFat(&output);
+        return NULL;
+    }
+
     return output;
 }
 
 /**
- * @brief      Given a directory file entry
+ * @brief      Loads the entries of the root directory file with one bulk read into a slab
  *
  * @param[out] fat                 The FAT filesystem
  * 
- * @return     SUCCESS on success, FAILURE on any failed malloc
+ * @return     SUCCESS on success, FAILURE on any failed malloc or read
  */
 int loadDirectoryEntries(fat *fat) {
     // check if the FAT already has directory entries initialized
     if (fat->fileCount != 0)
         return FAILURE;
 
-    // get file for the directory entry
-    file *directoryFile = getDirectoryFile(fat);
-
-    if (directoryFile == NULL) {
-        // Directory file not initialized
-        return SUCCESS;
-    }
-    
-    // read every file entry after the directory file entry and append to linked list
-    for (int i = 0; i < directoryFile->len; i = i + 64) {
-        // allocate memory for new entry node
-        directoryEntryNode *newNode = malloc(sizeof(directoryEntryNode));
-        newNode->next = NULL;
-
-        if (newNode == NULL) {
-            perror("malloc");
-            return FAILURE;
-        }
+    // read the whole directory file straight into one slab with room for every record the chain can hold
+    uint32_t capacity = getDirectoryBlockCount(fat) * (fat->blockSize / sizeof(directoryEntry));
+    directoryEntrySlab *slab = newDirectoryEntrySlab(capacity, fat);
+    if (slab == NULL)
+        return FAILURE;
 
-        // allocate memory for new entry
-        directoryEntry *newEntry = malloc(sizeof(directoryEntry));
+    int filesCounted = readDirectoryRecords(slab->entries, fat);
+    if (filesCounted == FAILURE)
+        return FAILURE;
 
-        if (newEntry == NULL) {
-            free(newNode);
-            perror("malloc");
+    // append every record's node to the linked list and the name index, incrementing fileCount
+    for (int i = 0; i < filesCounted; i++) {
+        if (appendDirectoryEntryNode(&slab->nodes[i], fat) == FAILURE)
             return FAILURE;
-        }
-
-        // copy bytes over to initialize directory entry
-        memcpy((uint8_t *) &newEntry->name, &directoryFile->bytes[i], 32 * sizeof(uint8_t));
-        memcpy((uint8_t *) &newEntry->size, &directoryFile->bytes[i + 32], 4 * sizeof(uint8_t));
-        memcpy((uint8_t *) &newEntry->firstBlock, &directoryFile->bytes[i + 36], 2 * sizeof(uint8_t));
-        memcpy((uint8_t *) &newEntry->type, &directoryFile->bytes[i + 38], 1 * sizeof(uint8_t));
-        memcpy((uint8_t *) &newEntry->perm, &directoryFile->bytes[i + 39], 1 * sizeof(uint8_t));
-        memcpy((uint8_t *) &newEntry->mtime, &directoryFile->bytes[i + 40], 8 * sizeof(uint8_t));
-        memcpy((uint8_t *) &newEntry->reserved, &directoryFile->bytes[i + 48], 16 * sizeof(uint8_t));
-
-        // set newNode's entry to be newEntry
-        newNode->entry = newEntry;
-
-        // check if list is empty
-        if (fat->fileCount == 0) {
-            // initialize list
-            fat->firstDirectoryEntryNode = newNode;
-            fat->lastDirectoryEntryNode = newNode;
-        } else {
-            // add new entry node to the end of the linked list
-            fat->lastDirectoryEntryNode->next = newNode;
-            fat->lastDirectoryEntryNode = newNode;
-        }
-
-        // reduce the number of freeblocks by 
-        fat->freeBlocks -= ceil((double) newEntry->size / fat->blockSize);
-
-        // increment fileCount
-        fat->fileCount++;
     }
 
-    // free the directory file
-    freeFile(directoryFile);
+    // keep the rest of the slab for files created later
+    releaseSlabNodes(slab, filesCounted, fat);
+
+    // every record loaded is already on disk
+    if (fat->dirtySlots != NULL)
+        memset(fat->dirtySlots, 0, fat->slotCapacity / 64 * sizeof(uint64_t));
+    fat->persistedCount = fat->fileCount;
 
     return SUCCESS;
 }
@@ -280,6 +759,18 @@ int saveFat(fat *fat) {
         return FAILURE;
     }
 
+    // write back dirty cached blocks
+    if (flushBlockCache(fat) == FAILURE) {
+        printf("Failed to write back cached blocks\n");
+        return FAILURE;
+    }
+
+    // schedule the mapped FAT (and data region when mapped) to be written back, without waiting for the disk
+    if (msync(fat->blocks, fat->mappedSize, MS_ASYNC) == -1) {
+        perror("msync");
+        return FAILURE;
+    }
+
     return SUCCESS;
 }
 
@@ -295,19 +786,43 @@ void freeFat(fat **fat) {
     if (theFat->fileName != NULL)
         free(theFat->fileName);
 
-    // free all directory entries
-    while (theFat->firstDirectoryEntryNode != NULL) {
-        directoryEntryNode *curr = theFat->firstDirectoryEntryNode;
-        theFat->firstDirectoryEntryNode = curr->next;
-        freeDirectoryEntryNode(curr);
+    // free all directory entries, which live in the slabs
+    while (theFat->slabs != NULL) {
+        directoryEntrySlab *curr = theFat->slabs;
+        theFat->slabs = curr->next;
+        free(curr);
     }
 
-    // unmap FAT table
-    if (munmap(theFat->blocks, theFat->numBlocks * theFat->blockSize) == -1) {
+    // free the name index and slot tables if allocated
+    if (theFat->nameIndex != NULL)
+        free(theFat->nameIndex);
+    if (theFat->slotNodes != NULL)
+        free(theFat->slotNodes);
+    if (theFat->dirtySlots != NULL)
+        free(theFat->dirtySlots);
+
+    // free the free block map if allocated
+    if (theFat->freeMap != NULL)
+        free(theFat->freeMap);
+
+    // write back and free the block cache
+    if (flushBlockCache(theFat) == FAILURE)
+        printf("Failed to write back cached blocks\n");
+    freeBlockCache(theFat->cache);
+
+    // flush and unmap FAT table, and the data region when the whole image is mapped
+    if (msync(theFat->blocks, theFat->mappedSize, MS_SYNC) == -1)
+        perror("msync");
+
+    if (munmap(theFat->blocks, theFat->mappedSize) == -1) {
         perror("munmap");
         return;
     }
 
+    // close the image descriptor
+    if (theFat->fd != -1 && close(theFat->fd) == -1)
+        perror("close");
+
     free(theFat);
 
     // ensure passed in pointer is NULL
@@ -11,6 +11,12 @@
  * @brief Alongside file.h, contains a FAT filesystem implementation along with functions for creating, saving and loading a FAT
  */
 
+// Whether mounting maps the whole image (FAT and data region) into memory, so that file data is copied to and from the
+// mapping instead of going through open/pread/pwrite, override with -DFAT_MAP_IMAGE=1 in CPPFLAGS
+#ifndef FAT_MAP_IMAGE
+#define FAT_MAP_IMAGE 0
+#endif
+
 /**
  * A directory entry in PennFAT, encompassing 64 bytes and
  * can be directly written into the FAT file on disk
@@ -27,8 +33,10 @@ typedef struct directoryEntryType {
     uint8_t reserved[16];
 } directoryEntry;
 
+struct fileDescriptorNodeType;
+
 /**
- * A linked list node containing a directory entry
+ * A doubly linked list node containing a directory entry, also chained into a bucket of the FAT's name index
  */
 typedef struct directoryEntryNodeType {
     // the directory entry of this node
@@ -36,10 +44,41 @@ typedef struct directoryEntryNodeType {
 
     // pointer to the next directory entry node
     struct directoryEntryNodeType *next;
+
+    // pointer to the previous directory entry node
+    struct directoryEntryNodeType *prev;
+
+    // pointer to the next node in the same name index bucket
+    struct directoryEntryNodeType *nextInBucket;
+
+    // index of this entry's 64 byte record in the directory file, matching its position in the list
+    uint32_t slot;
+
+    // the first of the files PennOS has open on this entry, so checking them never walks every open file
+    struct fileDescriptorNodeType *openFiles;
 } directoryEntryNode;
 
 /**
- * @brief      Creates a new directory entry node
+ * A chunk of directory entry nodes allocated at once, with the nodes' entries stored contiguously after them so that
+ * a whole directory file can be read straight into a slab
+ */
+typedef struct directoryEntrySlabType {
+    // next slab allocated for the same FAT
+    struct directoryEntrySlabType *next;
+
+    // number of nodes (and entries) in this slab
+    uint32_t count;
+
+    // the nodes, each pointing at the entry with the same index
+    directoryEntryNode *nodes;
+    directoryEntry *entries;
+} directoryEntrySlab;
+
+// FAT is defined below, the slab functions only need to know it exists
+struct fatType;
+
+/**
+ * @brief      Creates a new directory entry node, taking it from the FAT's slabs
  *
  * @param      fileName    The file name
  * @param[in]  size        The size
@@ -47,8 +86,9 @@ typedef struct directoryEntryNodeType {
  * @param[in]  type        The type
  * @param[in]  perm        The permission
  * @param[in]  time        The time
+ * @param      fat         The FAT
  *
- * @return     Pointer to a new directory entry node
+ * @return     Pointer to a new directory entry node, NULL if a new slab could not be allocated
  */
 directoryEntryNode *newDirectoryEntryNode(
     char *fileName,
@@ -56,15 +96,17 @@ directoryEntryNode *newDirectoryEntryNode(
     uint16_t firstBlock,
     uint8_t type,
     uint8_t perm,
-    time_t time
+    time_t time,
+    struct fatType *fat
 );
 
 /**
- * @brief      Frees a directory entry node
+ * @brief      Frees a directory entry node, returning it to the FAT's slabs for reuse
  *
  * @param      node  The directory entry node to free
+ * @param      fat   The FAT
  */
-void freeDirectoryEntryNode(directoryEntryNode *node);
+void freeDirectoryEntryNode(directoryEntryNode *node, struct fatType *fat);
 
 /**
  * FAT structure loaded and stored in memory
@@ -93,10 +135,93 @@ typedef struct fatType {
     // Last element in the linked list, useful for creating new files
     directoryEntryNode *lastDirectoryEntryNode;
 
+    // Hash index from file name to directory entry node, chained through nextInBucket
+    directoryEntryNode **nameIndex;
+    // Number of buckets in the name index, always a power of two
+    uint32_t nameIndexSize;
+
+    // Directory entry nodes indexed by slot, with room for slotCapacity nodes
+    directoryEntryNode **slotNodes;
+    uint32_t slotCapacity;
+
+    // Bitmap of slots whose records changed since the directory file was last written
+    uint64_t *dirtySlots;
+
+    // Number of records in the directory file on disk
+    uint32_t persistedCount;
+
+    // Slabs that directory entry nodes are allocated from, and the list (through next) of nodes not in use
+    directoryEntrySlab *slabs;
+    directoryEntryNode *freeNodes;
+
     // Array of block links
     uint16_t *blocks;
+
+    // Descriptor of the mounted image, kept open (O_RDWR) for block device I/O until the FAT is freed
+    int fd;
+
+    // Mapping of the whole image when mounted with FAT_MAP_IMAGE, NULL when only the FAT is mapped
+    uint8_t *image;
+
+    // Number of bytes mapped at blocks, covering the data region too when the whole image is mapped
+    size_t mappedSize;
+
+    // Write-back cache of data blocks (see blockdev.h), NULL when disabled or when the whole image is mapped
+    struct blockCacheType *cache;
+
+    // Bitmap of free blocks (bit set when the block is free), rebuilt from the block links at mount time
+    uint64_t *freeMap;
+
+    // Block to resume searching for free blocks from
+    uint32_t freeHint;
 } fat;
 
+/**
+ * @brief      Finds the directory entry node for a file name using the FAT's name index
+ *
+ * @param      fileName  The file name
+ * @param      fat       The FAT
+ *
+ * @return     The directory entry node, NULL if no file has that name
+ */
+directoryEntryNode *findDirectoryEntryNode(char *fileName, fat *fat);
+
+/**
+ * @brief      Adds a directory entry node to the end of the FAT's directory entry list and to its name index
+ *
+ * @param      node  The directory entry node
+ * @param      fat   The FAT
+ *
+ * @return     SUCCESS on success, FAILURE if growing the name index fails
+ */
+int appendDirectoryEntryNode(directoryEntryNode *node, fat *fat);
+
+/**
+ * @brief      Removes a directory entry node from the FAT's directory entry list and name index without freeing it.
+ *             The last node moves into the removed node's slot (and list position) so the directory file stays compact
+ *
+ * @param      node  The directory entry node
+ * @param      fat   The FAT
+ */
+void removeDirectoryEntryNode(directoryEntryNode *node, fat *fat);
+
+/**
+ * @brief      Marks a directory entry as changed, so that its record is rewritten with the next writeDirectoryFile
+ *
+ * @param      node  The directory entry node
+ * @param      fat   The FAT
+ */
+void markDirectoryEntryDirty(directoryEntryNode *node, fat *fat);
+
+/**
+ * @brief      Renames a directory entry node, moving it to the bucket of its new name in the name index
+ *
+ * @param      node         The directory entry node
+ * @param      newFileName  The new file name
+ * @param      fat          The FAT
+ */
+void renameDirectoryEntryNode(directoryEntryNode *node, char *newFileName, fat *fat);
+
 /**
  * @brief      Makes a PennFAT filesystem
  *             
@@ -109,6 +234,37 @@ typedef struct fatType {
  */
 fat *getFat(char *fileName, uint8_t numBlocks, uint8_t blockSizeIndicator, bool creating);
 
+/**
+ * @brief      Allocates a free block and links it after prev, preferring the block right after prev so that
+ *             chains stay contiguous on disk
+ *
+ * @param[in]  prev  The block to link the new block after, 0 if the new block starts a new chain
+ * @param      fat   The FAT
+ *
+ * @return     The index of the new block (already marked as the end of its chain), or 0 if there are no free blocks
+ */
+uint16_t allocateBlock(uint16_t prev, fat *fat);
+
+/**
+ * @brief      Allocates count blocks as a chain linked after prev, taking them as one contiguous extent whenever a
+ *             long enough run of free blocks exists
+ *
+ * @param[in]  prev   The block to link the new blocks after, 0 if the new blocks start a new chain
+ * @param[in]  count  The number of blocks to allocate
+ * @param      fat    The FAT
+ *
+ * @return     The index of the first new block, or 0 if there are not enough free blocks
+ */
+uint16_t allocateBlocks(uint16_t prev, uint32_t count, fat *fat);
+
+/**
+ * @brief      Returns a block to the free space of the FAT
+ *
+ * @param[in]  block  The block to free
+ * @param      fat    The FAT
+ */
+void freeBlock(uint16_t block, fat *fat);
+
 /**
  * @brief      Loads a PennFAT filesystem from disk
  *
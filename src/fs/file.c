@@ -9,6 +9,7 @@
 
 #include "fat.h"
 #include "file.h"
+#include "blockdev.h"
 #include "../include/macros.h"
 
 int bytesToBlocks(int numBytes, fat *fat) {
@@ -20,116 +21,114 @@ void freeFile(file *file) {
     free(file);
 }
 
-void getEntryNodeAndPrev(directoryEntryNode **prev, directoryEntryNode **found, char *fileName, fat *fat) {
-    directoryEntryNode *prevNode;
-    directoryEntryNode *entryNode = fat->firstDirectoryEntryNode;
-    
-    if (fileName == NULL)
-        return;
+int transferChain(uint16_t block, uint32_t offset, uint8_t *buf, uint32_t length, bool writing, fat *fat, uint16_t *lastBlock, uint32_t *links) {
+    uint32_t linksFollowed = 0;
+    uint32_t done = 0;
+
+    while (done < length) {
+        // extend the run for as long as the chain continues into the physically next block
+        uint32_t runBytes = fat->blockSize - offset;
+        uint16_t runEnd = block;
+        while (runBytes < length - done && fat->blocks[runEnd] == runEnd + 1) {
+            runEnd++;
+            runBytes += fat->blockSize;
+        }
 
-    while (entryNode != NULL) {
-        if (strcmp(entryNode->entry->name, fileName) == 0) {
-            break;
-        } else {
-            prevNode = entryNode;
-            entryNode = entryNode->next;
+        if (runBytes > length - done)
+            runBytes = length - done;
+
+        // transfer the whole run at once
+        int res = writing
+            ? writeBlocks(fat, block, offset, &buf[done], runBytes)
+            : readBlocks(fat, block, offset, &buf[done], runBytes);
+
+        if (res == FAILURE)
+            return FAILURE;
+
+        done += runBytes;
+        linksFollowed += runEnd - block;
+        block = runEnd;
+        offset = 0;
+
+        // move on to the start of the next run
+        if (done < length) {
+            block = fat->blocks[block];
+            linksFollowed++;
         }
     }
 
+    if (lastBlock != NULL)
+        *lastBlock = block;
+    if (links != NULL)
+        *links = linksFollowed;
+
+    return SUCCESS;
+}
+
+void getEntryNodeAndPrev(directoryEntryNode **prev, directoryEntryNode **found, char *fileName, fat *fat) {
+    // look the name up in the name index, the list is doubly linked so the previous node comes for free
+    directoryEntryNode *entryNode = findDirectoryEntryNode(fileName, fat);
+
     if (prev != NULL)
-        *prev = prevNode;
+        *prev = entryNode == NULL ? NULL : entryNode->prev;
     if (found != NULL)
         *found = entryNode;
 }
 
-file *getDirectoryFile(fat *fat) {
-    // get number of files in the root directory
-    // open the file
-    int fd;
-    if ((fd = open(fat->fileName, O_RDWR, 0644)) == -1) {
-        perror("open");
-        return NULL;
-    }
+uint32_t getDirectoryBlockCount(fat *fat) {
+    uint32_t blockCount = 1;
+    for (uint16_t currIndex = 1; fat->blocks[currIndex] != 0xFFFF; currIndex = fat->blocks[currIndex])
+        blockCount++;
 
-    // seek to the first block
-    uint32_t fatSize = fat->numBlocks * fat->blockSize;
-    uint16_t currIndex = 1;
-
-    if (lseek(fd, fatSize, SEEK_SET) == -1) {
-        perror("lseek");
-        return NULL;
-    }
+    return blockCount;
+}
 
-    // keep track of how many files we counted
-    unsigned int filesCounted = 0;
+int readDirectoryRecords(directoryEntry *records, fat *fat) {
+    uint32_t capacity = getDirectoryBlockCount(fat) * (fat->blockSize / sizeof(directoryEntry));
 
-    // temporary buffer to store bytes read
-    uint8_t buffer[sizeof(directoryEntry)];
-    for (int i = 0; i < sizeof(directoryEntry); i++)
-        buffer[i] = 0x00;
+    // read the whole chain at once, the records are laid out on disk exactly like directoryEntry
+    if (transferChain(1, 0, (uint8_t *) records, capacity * sizeof(directoryEntry), false, fat, NULL, NULL) == FAILURE)
+        return FAILURE;
 
-    // read 64 bytes at a time, finding a new block every time we read (blockSize) bytes until
-    // we read a file where the first byte is NULL
-    
-    bool endedAtEdgeOfBlock = false;
-    while (1) {
-        if (filesCounted != 0 && (filesCounted * sizeof(directoryEntry)) % fat->blockSize == 0) {
-            if (fat->blocks[currIndex] == 0xFFFF) {
-                // if we have reached the end of a block and this is the last block, then we are done
-                endedAtEdgeOfBlock = true;
-                break;
-            }
-            // get next block to start reading from
-            currIndex = fat->blocks[currIndex];
-            if (lseek(fd, fatSize + ((currIndex - 1) * fat->blockSize), SEEK_SET) == -1) {
-                perror("lseek");
-                return NULL;
-            }
-        }
+    // the records end at the first one starting with a null byte, or at the end of the chain
+    uint32_t filesCounted = 0;
+    while (filesCounted < capacity && records[filesCounted].name[0] != '\0')
+        filesCounted++;
 
-        // read 64 bytes into the buffer
-        if (read(fd, buffer, sizeof(directoryEntry)) == -1) {
-            perror("read");
-            return NULL;
-        }
+    return filesCounted;
+}
 
-        // check if the first byte was null, if so, break
-        // otherwise continue reading and incr filesCounted
-        if (buffer[0] == 0x00)
-            break;
-        else
-            filesCounted++;
+file *getDirectoryFile(fat *fat) {
+    // read every record of the root directory in one pass
+    directoryEntry *records = malloc(getDirectoryBlockCount(fat) * fat->blockSize);
+    if (records == NULL) {
+        perror("malloc");
+        return NULL;
     }
 
-    // close fd
-    if (close(fd) == -1) {
-        perror("close");
+    int filesCounted = readDirectoryRecords(records, fat);
+
+    // return NULL if no files found (or the read failed), otherwise return the records
+    if (filesCounted <= 0) {
+        free(records);
         return NULL;
     }
 
-    // return NULL if no files found, otherwise, copy the first filesCounted * 64 bytes to heap and return
-    if (filesCounted == 0) {
+    // formulate output file
+    file *out = malloc(sizeof(file));
+    if (out == NULL) {
+        perror("malloc");
+        free(records);
         return NULL;
-    } else {
-        uint8_t *bytes = getBytes(1, filesCounted * sizeof(directoryEntry) + endedAtEdgeOfBlock, fat);
-
-        // check if getBytes failed
-        if (bytes == NULL) {
-            perror("malloc");
-            return NULL;
-        }
-
-        // formulate output file
-        file *out = malloc(sizeof(file));
+    }
 
-        // set file details
-        out->bytes = bytes;
-        out->len = filesCounted * sizeof(directoryEntry);
-        out->type = DIRECTORY_FILETYPE;
-        out->perm = NONE_PERMS;
+    // set file details
+    out->bytes = (uint8_t *) records;
+    out->len = filesCounted * sizeof(directoryEntry);
+    out->type = DIRECTORY_FILETYPE;
+    out->perm = NONE_PERMS;
 
-        return out;
-    }
+    return out;
 }
 
 uint8_t *getBytes(uint16_t startIndex, uint32_t length, fat *fat) {
@@ -143,57 +142,86 @@ uint8_t *getBytes(uint16_t startIndex, uint32_t length, fat *fat) {
     // null terminate this byte array
     result[length] = '\0';
 
-    // read bytes from FAT storage for each block of this file
-    // open the file to read from and check for errors
-    int fd;
-    if ((fd = open(fat->fileName, O_RDONLY, 0644)) == -1) {
-        perror("open");
+    // read bytes from FAT storage for each block of this file, one read per run of consecutive blocks
+    if (transferChain(startIndex, 0, result, length, false, fat, NULL, NULL) == FAILURE) {
         free(result);
         return NULL;
     }
 
-    // seek to the first empty block
-    uint32_t fatSize = fat->numBlocks * fat->blockSize;
-    uint16_t currIndex = startIndex;
+    return result;
+}
 
-    if (lseek(fd, fatSize + ((currIndex - 1) * fat->blockSize), SEEK_SET) == -1) {
-        perror("lseek");
-        free(result);
-        return NULL;
+void resetFileCursor(fileCursor *cursor) {
+    cursor->firstBlock = 0;
+    cursor->block = 0;
+    cursor->chainIndex = 0;
+}
+
+/**
+ * @brief      Helper to find the block at some position in a file's chain, continuing from the cursor instead of
+ *             the first block whenever the cursor is valid and not past that position
+ *
+ * @param      entry       The directory entry of the file
+ * @param      cursor      The cursor cached for this file, NULL if unused
+ * @param[in]  chainIndex  The position in the chain of the block to find
+ * @param      fat         The FAT filesystem
+ *
+ * @return     The index of the block at chainIndex, the cursor is left pointing at it
+ */
+uint16_t seekBlock(directoryEntry *entry, fileCursor *cursor, uint32_t chainIndex, fat *fat) {
+    uint16_t currIndex = entry->firstBlock;
+    uint32_t currChainIndex = 0;
+
+    if (cursor != NULL && cursor->firstBlock != 0 && cursor->firstBlock == entry->firstBlock && cursor->chainIndex <= chainIndex) {
+        currIndex = cursor->block;
+        currChainIndex = cursor->chainIndex;
     }
 
-    // read all (length) bytes, finding a new block every time we read (blockSize) bytes
-    for (int i = 0; i < length; i = i + fat->blockSize) {
-        if (i != 0 && i % fat->blockSize == 0) {
-            // get next block to start reading from
-            currIndex = fat->blocks[currIndex];
-            if (lseek(fd, fatSize + ((currIndex - 1) * fat->blockSize), SEEK_SET) == -1) {
-                perror("lseek");
-                free(result);
-                return NULL;
-            }
-        }
+    while (currChainIndex < chainIndex) {
+        currIndex = fat->blocks[currIndex];
+        currChainIndex++;
+    }
 
-        // read the smaller of blockSize or length - i;
-        int bytesToRead = fat->blockSize;
-        if (bytesToRead > length - i)
-            bytesToRead = length - i;
+    if (cursor != NULL) {
+        cursor->firstBlock = entry->firstBlock;
+        cursor->block = currIndex;
+        cursor->chainIndex = chainIndex;
+    }
 
-        if (read(fd, &result[i], bytesToRead) == -1) {
-            perror("read");
-            free(result);
-            return NULL;
-        }
+    return currIndex;
+}
+
+int readBytesFromFAT(directoryEntry *entry, uint32_t offset, uint32_t length, uint8_t *buf, fat *fat, fileCursor *cursor) {
+    if (entry->perm != READWRITE_PERMS && entry->perm != READ_PERMS) {
+        printf("%s lacks read permission\n", entry->name);
+        return FAILURE;
     }
 
-    // close the file
-    if (close(fd) == -1) {
-        perror("close");
-        free(result);
-        return NULL;
+    // nothing to read at or past EOF
+    if (offset >= entry->size || length == 0)
+        return 0;
+
+    // clamp the read to the end of the file
+    if (length > entry->size - offset)
+        length = entry->size - offset;
+
+    // find the block that holds offset
+    uint32_t chainIndex = offset / fat->blockSize;
+    uint16_t currIndex = seekBlock(entry, cursor, chainIndex, fat);
+
+    // read all (length) bytes, one read per run of consecutive blocks
+    uint32_t links = 0;
+    if (transferChain(currIndex, offset % fat->blockSize, buf, length, false, fat, &currIndex, &links) == FAILURE)
+        return FAILURE;
+    chainIndex += links;
+
+    // leave the cursor on the last block read so the next sequential read continues from there
+    if (cursor != NULL) {
+        cursor->block = currIndex;
+        cursor->chainIndex = chainIndex;
     }
 
-    return result;
+    return length;
 }
 
 file *readFileFromFAT(char *fileName, fat *fat) {
@@ -236,39 +264,30 @@ file *readFileFromFAT(char *fileName, fat *fat) {
 /**
  * @brief      Helper to delete the block links associated with an entryNode
  *
- * @param      prev       The node immediately previous to the entry node, NULL if it doesn't exist
  * @param      entryNode  The entry node whose block links to delete
  * @param      fat        The FAT filesystem
- * @param      dirFile    Only true when writing directory file
  */
-void deleteFileHelper(directoryEntryNode *prev, directoryEntryNode *entryNode, fat *fat, bool dirFile) {
+void deleteFileHelper(directoryEntryNode *entryNode, fat *fat) {
     // clear blocks in FAT
-    uint16_t currBlock;
-    if (dirFile) {
-        // handle case for overwriting directory file
-        currBlock = 1;
-    } else {
-        currBlock = entryNode->entry->firstBlock;
-    }
+    if (entryNode->entry->size == 0)
+        return;
+    uint16_t currBlock = entryNode->entry->firstBlock;
 
-    if (dirFile || entryNode->entry->size != 0) {
-        // delete all blocks for this file
-        do {
-            // get next block
-            uint16_t nextBlock = fat->blocks[currBlock];
-            // clear current block
-            fat->blocks[currBlock] = 0;
-            // set next block as current block
-            currBlock = nextBlock;
-        } while (currBlock != 0xFFFF && currBlock != 0x0000);
+    // return all blocks of this file to the free map
+    while (currBlock != 0xFFFF && currBlock != 0x0000) {
+        // get next block
+        uint16_t nextBlock = fat->blocks[currBlock];
+        // clear current block
+        freeBlock(currBlock, fat);
+        // set next block as current block
+        currBlock = nextBlock;
     }
 }
 
 int deleteFileFromFAT(char *fileName, fat *fat, bool syscall) {
     // find the directory entry that matches this filename, if it exists
-    directoryEntryNode *prev;
     directoryEntryNode *entryNode;
-    getEntryNodeAndPrev(&prev, &entryNode, fileName, fat);
+    getEntryNodeAndPrev(NULL, &entryNode, fileName, fat);
 
     // check if we found a node corresponding to the supplied fileName
     if (entryNode == NULL) {
@@ -283,26 +302,14 @@ int deleteFileFromFAT(char *fileName, fat *fat, bool syscall) {
     }
 
     // delete block links
-    deleteFileHelper(prev, entryNode, fat, false);
-
-    // delete this entry node from the linked list
-    // set first node pointer to the next entry if this entry is the first entry
-    // otherwise set previous entry's next to this entry's next
-    if (entryNode == fat->firstDirectoryEntryNode)
-        fat->firstDirectoryEntryNode = entryNode->next;
-    else
-        prev->next = entryNode->next;
+    deleteFileHelper(entryNode, fat);
 
-    // set last node pointer to the prev entry if this entry is the last entry
-    if (entryNode == fat->lastDirectoryEntryNode)
-        fat->lastDirectoryEntryNode = prev;
-
-    // decrement filecount and increase freeblocks by the number of blocks taken up by the file
-    fat->fileCount--;
-    fat->freeBlocks += bytesToBlocks(entryNode->entry->size, fat);
+    // delete this entry node from the linked list and the name index and decrement filecount,
+    // the file's blocks were already returned to the free map
+    removeDirectoryEntryNode(entryNode, fat);
 
     // free this node
-    freeDirectoryEntryNode(entryNode);
+    freeDirectoryEntryNode(entryNode, fat);
 
     return SUCCESS;
 }
@@ -328,30 +335,30 @@ int renameFile(char *oldFileName, char *newFileName, fat *fat) {
     directoryEntryNode *newFileNode;
     getEntryNodeAndPrev(NULL, &newFileNode, newFileName, fat);
 
-    // if so, try to delete it
-    if (newFileNode != NULL) {
+    // if so (and it is not the file being renamed), try to delete it
+    if (newFileNode != NULL && newFileNode != entryNode) {
         if (deleteFileFromFAT(newFileNode->entry->name, fat, false) == FAILURE) {
             printf("Failed to overwrite %s\n", newFileNode->entry->name);
         }
     }
 
-    // rename file
-    strcpy(entryNode->entry->name, newFileName);
+    // rename file, moving it to its new bucket in the name index
+    renameDirectoryEntryNode(entryNode, newFileName, fat);
 
     // update timestamp
     entryNode->entry->mtime = time(NULL);
 
     // update timestamp of directory file
     fat->firstDirectoryEntryNode->entry->mtime = entryNode->entry->mtime;
+    markDirectoryEntryDirty(fat->firstDirectoryEntryNode, fat);
 
     return SUCCESS;
 }
 
-int writeFileToFAT(char *fileName, uint8_t *bytes, uint32_t fileOffset, uint32_t length, uint8_t type, uint8_t perm, fat *fat, bool appending, bool syscall, bool writeDir) {
+int writeFileToFAT(char *fileName, uint8_t *bytes, uint32_t fileOffset, uint32_t length, uint8_t type, uint8_t perm, fat *fat, bool appending, bool syscall, fileCursor *cursor) {
     // find the directory entry that matches this filename, if it exists
-    directoryEntryNode *prev;
     directoryEntryNode *entryNode;
-    getEntryNodeAndPrev(&prev, &entryNode, fileName, fat);
+    getEntryNodeAndPrev(NULL, &entryNode, fileName, fat);
 
     // check if the file has write permissions
     if (!syscall && entryNode != NULL && entryNode->entry->perm != WRITE_PERMS && entryNode->entry->perm != READWRITE_PERMS) {
@@ -359,28 +366,44 @@ int writeFileToFAT(char *fileName, uint8_t *bytes, uint32_t fileOffset, uint32_t
         return FAILURE;
     }
 
+    // appends and writes at an offset into an existing file continue its chain in place, everything else
+    // (new files and overwrites from the start of the file) replaces the chain
+    bool inPlace = entryNode != NULL && (appending || fileOffset > 0);
+
+    // byte offset within the file to start writing at when writing in place
+    uint32_t start = 0;
+
+    if (inPlace) {
+        start = appending ? entryNode->entry->size : fileOffset;
+
+        if (start > entryNode->entry->size) {
+            printf("Cannot write to at offset greater than file length\n");
+            return FAILURE;
+        }
+
+        // nothing to write, just update the timestamp
+        if (length == 0) {
+            entryNode->entry->mtime = time(NULL);
+            markDirectoryEntryDirty(entryNode, fat);
+            return SUCCESS;
+        }
+    }
+
     // calculate the number of free blocks taken or created by this write
     int32_t changeInFreeBlocks = 0;
 
-    // required blocks depends on whether we should create a new directory entry, if we're appending, or just overwriting
-    if (syscall && writeDir) {
-        // will not change free blocks
-    } else if (entryNode == NULL) {
+    // required blocks depends on whether we should create a new directory entry, if we're writing in place, or just overwriting
+    if (entryNode == NULL) {
         // if the directory file needs to expand, then we need an extra block
         if (fat->fileCount != 0 && (sizeof(directoryEntry) * fat->fileCount) % fat->blockSize == 0)
             changeInFreeBlocks -= 1;
         
         // need enough free blocks for the content of the file
         changeInFreeBlocks -= bytesToBlocks(length, fat);
-    } else if (appending) {
-        // need enough free blocks for the content of the file minus the free space in the last block of the file
-        if (entryNode->entry->size % fat->blockSize == 0)
-            changeInFreeBlocks -= bytesToBlocks(length, fat);
-        else
-            changeInFreeBlocks -= bytesToBlocks(length - (fat->blockSize - (entryNode->entry->size % fat->blockSize)), fat);
-    } else if (fileOffset > 0) {
-        // change in free blocks is (required blocks for new file) - (freed blocks from old file)
-        changeInFreeBlocks -= bytesToBlocks(fileOffset + length, fat) - bytesToBlocks(entryNode->entry->size, fat);
+    } else if (inPlace) {
+        // only need new blocks for the part of the write that runs past the end of the file
+        if (start + length > entryNode->entry->size)
+            changeInFreeBlocks -= bytesToBlocks(start + length, fat) - bytesToBlocks(entryNode->entry->size, fat);
     } else {
         // change in free blocks is (required blocks for new file) - (freed blocks from old file)
         changeInFreeBlocks -= bytesToBlocks(length, fat) - bytesToBlocks(entryNode->entry->size, fat);
@@ -392,234 +415,197 @@ int writeFileToFAT(char *fileName, uint8_t *bytes, uint32_t fileOffset, uint32_t
         return FAILURE;
     }
 
-    // delete original file's block links, if it exists and we are not appending
-    if (writeDir || (entryNode != NULL && !appending)) {
-        deleteFileHelper(prev, entryNode, fat, syscall && writeDir);
-    }
-
-    // get the index of the first free block or the last block of the file if appending to nonempty file and file does not
-    // perfectly fill up the last block, i.e. length % blocksize != 0
-    uint16_t currIndex = 1;
-
-    // offset from the first block's first byte to write at, zero if empty file or new file, size % blocksize if nonempty and appending
+    // the block to start writing at, its position in the chain, and the offset within it to start writing at
+    uint16_t currIndex = 0;
+    uint32_t chainIndex = 0;
     uint32_t offset = 0;
 
-    if (syscall && writeDir) {
-        // curr index will be 1 and offset 0 if writing directory file
-        currIndex = 1;
-        offset = 0;
-    } else if (appending && entryNode != NULL && entryNode->entry->size != 0) {
-        // get the last block of the file to append to
-        currIndex = entryNode->entry->firstBlock;
-        while (fat->blocks[currIndex] != 0xFFFF) {
-            currIndex = fat->blocks[currIndex];
-        }
-
-        if (entryNode->entry->size % fat->blockSize == 0) {
-            // find free free block and set current block pointer to that block
-            uint16_t nextIndex = 0;
-            for (unsigned int i = 1; i < fat->numEntries; i++) {
-                if (fat->blocks[i] == 0) {
-                    nextIndex = i;
-                    break;
-                }
-            }
-            fat->blocks[currIndex] = nextIndex;
-            currIndex = nextIndex;
-        }
-
-        // get current offset of file's end
-        offset = entryNode->entry->size % fat->blockSize;
-    } else if (fileOffset > 0 && entryNode != NULL) {
-        if (fileOffset > entryNode->entry->size) {
-            printf("Cannot write to at offset greater than file length\n");
-            return FAILURE;
-        }
-
-        // get the block where the offset lies in
-        currIndex = entryNode->entry->firstBlock;
-
-        int blockAt = fileOffset / fat->blockSize; 
+    // store the first index of this file
+    uint16_t firstIndex = 0;
+
+    // every block the write needs is allocated up front so that they can be taken as one contiguous extent
+    bool allocFailed = false;
+
+    if (inPlace) {
+        directoryEntry *entry = entryNode->entry;
+        uint32_t oldBlocks = bytesToBlocks(entry->size, fat);
+        uint32_t newBlocks = 0;
+        if (start + length > entry->size)
+            newBlocks = bytesToBlocks(start + length, fat) - oldBlocks;
+
+        firstIndex = entry->firstBlock;
+        chainIndex = start / fat->blockSize;
+        offset = start % fat->blockSize;
+
+        if (entry->size == 0) {
+            // empty files have no chain yet
+            currIndex = allocateBlocks(0, newBlocks, fat);
+            firstIndex = currIndex;
+        } else if (chainIndex == oldBlocks) {
+            // the last block is full, so the write starts in the first new block
+            currIndex = allocateBlocks(seekBlock(entry, cursor, chainIndex - 1, fat), newBlocks, fat);
+        } else {
+            currIndex = seekBlock(entry, cursor, chainIndex, fat);
 
-        for (int i = 0; i < blockAt; i++) {
-            currIndex = fat->blocks[currIndex];
-        }
+            // extend the chain from its last block if the write runs past it
+            if (newBlocks > 0) {
+                uint16_t lastIndex = currIndex;
+                while (fat->blocks[lastIndex] != 0xFFFF)
+                    lastIndex = fat->blocks[lastIndex];
 
-        if (entryNode->entry->size % fat->blockSize == 0) {
-            // find free free block and set current block pointer to that block
-            uint16_t nextIndex = 0;
-            for (unsigned int i = 1; i < fat->numEntries; i++) {
-                if (fat->blocks[i] == 0) {
-                    nextIndex = i;
-                    break;
-                }
+                allocFailed = allocateBlocks(lastIndex, newBlocks, fat) == 0;
             }
-            fat->blocks[currIndex] = nextIndex;
-            currIndex = nextIndex;
         }
-
-        // get current offset of file's end
-        offset = fileOffset % fat->blockSize;
     } else {
-        // get first free block
-        for (unsigned int i = 1; i < fat->numEntries; i++) {
-            if (fat->blocks[i] == 0) {
-                currIndex = i;
-                break;
-            }
+        // delete original file's block links, if it exists
+        if (entryNode != NULL)
+            deleteFileHelper(entryNode, fat);
+
+        if (length != 0) {
+            currIndex = allocateBlocks(0, bytesToBlocks(length, fat), fat);
         }
+        firstIndex = currIndex;
     }
 
-    // store the first index of this file
-    uint16_t firstIndex = currIndex;
-
-    // write bytes to FAT storage for each open block
-    // open the file to write to and check for errors
-    int fd;
-    if ((fd = open(fat->fileName, O_WRONLY | O_CREAT, 0644)) == -1) {
-        perror("open");
-        return FAILURE;
-    }
-    // seek to the first empty block
-    uint32_t fatSize = fat->numBlocks * fat->blockSize;
-    if (lseek(fd, fatSize + ((currIndex - 1) * fat->blockSize) + offset, SEEK_SET) == -1) {
-        perror("lseek");
+    if (allocFailed || (length != 0 && currIndex == 0)) {
+        printf("Not enough free blocks\n");
         return FAILURE;
     }
 
-    // write all (length) bytes in as few write calls as possible, finding a new block every time when necessary
-    int byteIdx = 0;
-    while (byteIdx < length) {
-        if (byteIdx != 0 && (byteIdx + offset) % fat->blockSize == 0) {
-            if (fat->blocks[currIndex] == 0x0000 || fat->blocks[currIndex] == 0xFFFF) {
-                // find new block and start writing in new block
-                uint16_t nextIndex = currIndex + 1;
-                // check if nextIndex is out of bounds, if so, wrap around to the second block of data section
-                if (nextIndex >= fat->numEntries)
-                    nextIndex = 2;
-
-                for (unsigned int j = nextIndex; j < fat->numEntries; j++) {
-                    if (fat->blocks[j] == 0) {
-                        nextIndex = j;
-                        break;
-                    }
-                }
-                fat->blocks[currIndex] = nextIndex;
-                currIndex = nextIndex;
-                if (lseek(fd, fatSize + ((currIndex - 1) * fat->blockSize), SEEK_SET) == -1) {
-                    perror("lseek");
-                    return FAILURE;
-                }   
-            } else {
-                currIndex = fat->blocks[currIndex];
-            }
-        }
-
-        // write either enough bytes to get to the end of this block or the number of bytes to the end of the file,
-        // whichever is smaller
-        int bytesToWrite = fat->blockSize - (byteIdx + offset) % fat->blockSize;
-        if (bytesToWrite > length - byteIdx)
-            bytesToWrite = length - byteIdx;
-
-
-        // in case successful write doesn't write all the bytes
-        int totalBytesWritten = 0;
-        while (totalBytesWritten < bytesToWrite) {
-            int bytesWritten = write(fd, &bytes[byteIdx], bytesToWrite);
-
-            if (bytesWritten == -1) {
-                perror("write");
-                return FAILURE;
-            }
-
-            totalBytesWritten += bytesWritten;
-        }
-
-        byteIdx = byteIdx + bytesToWrite;
-    }
-
-    // set final block's next block link to be 0xFFFF i.e. end of file, if the length is nonzero
-    if (length != 0)
-        fat->blocks[currIndex] = 0xFFFF;
-    else
-        firstIndex = 0x0000;
-
-    // close and save the file
-    if (close(fd) == -1) {
-        perror("close");
+    // write all (length) bytes to FAT storage, one write per run of consecutive blocks
+    uint32_t links = 0;
+    if (transferChain(currIndex, offset, bytes, length, true, fat, &currIndex, &links) == FAILURE)
         return FAILURE;
-    }
+    chainIndex += links;
 
     // create a new directory entry and node if it was NULL
-    if (syscall && writeDir) {
-        // do nothing -- we just needed to update the file on disk
-    } else if (entryNode == NULL) {
-        directoryEntryNode *newNode = newDirectoryEntryNode(fileName, length, firstIndex, type, perm, time(NULL));
-
-        // check if list has been initialized
-        if (fat->fileCount == 0) {
-            // initialize linked list
-            fat->firstDirectoryEntryNode = newNode;
-            fat->lastDirectoryEntryNode = newNode;
-        } else {
-            // add new entry to end of list
-            fat->lastDirectoryEntryNode->next = newNode;
-            fat->lastDirectoryEntryNode = newNode;
-        }
+    if (entryNode == NULL) {
+        directoryEntryNode *newNode = newDirectoryEntryNode(fileName, length, firstIndex, type, perm, time(NULL), fat);
+        if (newNode == NULL)
+            return FAILURE;
 
-        // update file count free space
-        fat->fileCount++;
+
+        // add new entry to end of list and to the name index, updating file count
+        if (appendDirectoryEntryNode(newNode, fat) == FAILURE) {
+            freeDirectoryEntryNode(newNode, fat);
+            return FAILURE;
+        }
     } else {
         // update existing entry size
-        if (fileOffset > 0 && fileOffset + length > entryNode->entry->size) {
-            entryNode->entry->size = fileOffset + length;
-        } else if (appending) {
-            entryNode->entry->size += length;
+        if (inPlace) {
+            if (start + length > entryNode->entry->size)
+                entryNode->entry->size = start + length;
         } else {
             entryNode->entry->size = length;
         }
-        if (!appending)
-            entryNode->entry->firstBlock = firstIndex;
+        entryNode->entry->firstBlock = firstIndex;
         entryNode->entry->mtime = time(NULL);
+        markDirectoryEntryDirty(entryNode, fat);
     }
 
-    // update number of free blocks
-    fat->freeBlocks += changeInFreeBlocks;
+    // leave the cursor on the last block written so the next sequential access continues from there
+    if (cursor != NULL && length != 0) {
+        cursor->firstBlock = firstIndex;
+        cursor->block = currIndex;
+        cursor->chainIndex = chainIndex;
+    }
 
     return SUCCESS;
 }
 
-int appendToFileInFAT(char *fileName, uint8_t *bytes, uint32_t length, fat *fat, bool syscall) {
-    return writeFileToFAT(fileName, bytes, 0, length, REGULAR_FILETYPE, READWRITE_PERMS, fat, true, syscall, false);
+int appendToFileInFAT(char *fileName, uint8_t *bytes, uint32_t length, fat *fat, bool syscall, fileCursor *cursor) {
+    return writeFileToFAT(fileName, bytes, 0, length, REGULAR_FILETYPE, READWRITE_PERMS, fat, true, syscall, cursor);
+}
+
+/**
+ * @brief      Helper to grow or shrink the directory file's chain (which always keeps block 1) to a number of blocks
+ *
+ * @param[in]  blocksNeeded  The number of blocks the directory file should take up, at least 1
+ * @param      fat           The FAT filesystem
+ *
+ * @return     SUCCESS on success, FAILURE if there are not enough free blocks
+ */
+int resizeDirectoryChain(uint32_t blocksNeeded, fat *fat) {
+    // walk to the last block that should be kept, or the end of the chain if it is too short
+    uint16_t currBlock = 1;
+    uint32_t blocksHeld = 1;
+    while (blocksHeld < blocksNeeded && fat->blocks[currBlock] != 0xFFFF) {
+        currBlock = fat->blocks[currBlock];
+        blocksHeld++;
+    }
+
+    if (blocksHeld < blocksNeeded) {
+        // extend the chain
+        if (allocateBlocks(currBlock, blocksNeeded - blocksHeld, fat) == 0) {
+            printf("Not enough free blocks\n");
+            return FAILURE;
+        }
+    } else {
+        // free everything after the last block kept
+        uint16_t nextBlock = fat->blocks[currBlock];
+        fat->blocks[currBlock] = 0xFFFF;
+        while (nextBlock != 0xFFFF) {
+            uint16_t freed = nextBlock;
+            nextBlock = fat->blocks[freed];
+            freeBlock(freed, fat);
+        }
+    }
+
+    return SUCCESS;
 }
 
 int writeDirectoryFile(fat *fat) {
-    // gather bytes to write (including a null byte after the end of the last entry if the number of files does not perfectly fill up a block)
-    uint32_t fileSize = fat->fileCount * sizeof(directoryEntry);
-    uint32_t length = fileSize;
-    if (fileSize % fat->blockSize != 0)
-        length += 1;
+    uint32_t perBlock = fat->blockSize / sizeof(directoryEntry);
+    bool countChanged = fat->fileCount != fat->persistedCount;
+
+    // the chain only changes length when files were created or deleted
+    if (countChanged) {
+        uint32_t blocksNeeded = fat->fileCount == 0 ? 1 : (fat->fileCount + perBlock - 1) / perBlock;
+        if (resizeDirectoryChain(blocksNeeded, fat) == FAILURE)
+            return FAILURE;
+    }
 
-    uint8_t bytes[length];
+    // rewrite only the records that changed, walking the chain once in slot order
+    uint16_t currBlock = 1;
+    uint32_t chainIndex = 0;
+    for (uint32_t word = 0; word * 64 < fat->fileCount; word++) {
+        while (fat->dirtySlots[word] != 0) {
+            uint32_t slot = word * 64 + __builtin_ctzll(fat->dirtySlots[word]);
+            fat->dirtySlots[word] &= fat->dirtySlots[word] - 1;
 
-    if (fileSize % fat->blockSize != 0)
-        bytes[length - 1] = 0x00;
+            // slots past the last record have nothing left to write
+            if (slot >= fat->fileCount) {
+                fat->dirtySlots[word] = 0;
+                break;
+            }
+
+            for (; chainIndex < slot / perBlock; chainIndex++)
+                currBlock = fat->blocks[currBlock];
 
-    int bufIdx = 0;
-    directoryEntryNode *entryNode = fat->firstDirectoryEntryNode;
-    while (entryNode != NULL) {
-        // copy entry bytes into buffer
-        memcpy(&bytes[bufIdx], entryNode->entry, sizeof(directoryEntry));
-        entryNode = entryNode->next;
-        bufIdx += sizeof(directoryEntry);
+            uint32_t offset = (slot % perBlock) * sizeof(directoryEntry);
+            if (writeBlocks(fat, currBlock, offset, (uint8_t *) fat->slotNodes[slot]->entry, sizeof(directoryEntry)) == FAILURE) {
+                printf("Failed to save directory file\n");
+                return FAILURE;
+            }
+        }
     }
 
+    // end the records with a null byte unless they end exactly at the end of the chain, covering whatever a
+    // previous (longer) directory or a newly allocated block left behind (an empty directory still has block 1)
+    if (countChanged && (fat->fileCount == 0 || fat->fileCount % perBlock != 0)) {
+        for (; chainIndex < fat->fileCount / perBlock; chainIndex++)
+            currBlock = fat->blocks[currBlock];
 
-    if (writeFileToFAT(NULL, bytes, 0, length, DIRECTORY_FILETYPE, NONE_PERMS, fat, false, true, true) == -1) {
-        printf("Failed to save directory file\n");
-        return FAILURE;
+        uint8_t terminator = 0x00;
+        uint32_t offset = (fat->fileCount % perBlock) * sizeof(directoryEntry);
+        if (writeBlocks(fat, currBlock, offset, &terminator, sizeof(uint8_t)) == FAILURE) {
+            printf("Failed to save directory file\n");
+            return FAILURE;
+        }
     }
 
+    fat->persistedCount = fat->fileCount;
+
     return SUCCESS;
 }
 
@@ -638,6 +624,7 @@ int chmodFile(fat *fat, char *fileName, int newPerms) {
     }
 
     foundNode->entry->perm = newPerms;
+    markDirectoryEntryDirty(foundNode, fat);
 
     return SUCCESS;
 }
@@ -20,6 +20,26 @@ typedef struct fileType {
     uint8_t perm;
 } file;
 
+/**
+ * Cached position in a file's block chain, letting sequential reads and writes continue from the last block they
+ * touched instead of walking the chain from the first block on every access
+ */
+typedef struct fileCursorType {
+    // first block of the chain this cursor was filled in for, 0 if the cursor is invalid
+    uint16_t firstBlock;
+    // index in the FAT of the cached block
+    uint16_t block;
+    // position of the cached block in the chain, i.e. the block holds bytes [chainIndex * blockSize, (chainIndex + 1) * blockSize)
+    uint32_t chainIndex;
+} fileCursor;
+
+/**
+ * @brief      Invalidates a cursor, used when the chain it points into is freed or replaced
+ *
+ * @param      cursor  The cursor
+ */
+void resetFileCursor(fileCursor *cursor);
+
 /**
  * @brief      Frees a file struct pointer and its bytes
  *
@@ -37,6 +57,42 @@ void freeFile(file *file);
  */
 void getEntryNodeAndPrev(directoryEntryNode **prev, directoryEntryNode **found, char *fileName, fat *fat);
 
+/**
+ * @brief      Reads or writes bytes along a block chain, issuing a single block device transfer for every run of
+ *             physically consecutive blocks
+ *
+ * @param[in]  block      The block to start at
+ * @param[in]  offset     The byte offset within block to start at
+ * @param      buf        The buffer to read into or write from
+ * @param[in]  length     The number of bytes to transfer, the chain must already be long enough to hold them
+ * @param[in]  writing    Whether to write buf into the chain rather than read the chain into buf
+ * @param      fat        The FAT filesystem
+ * @param      lastBlock  Set to the last block touched, NULL if unused
+ * @param      links      Set to the number of links followed from block to lastBlock, NULL if unused
+ *
+ * @return     SUCCESS on success, FAILURE if any transfer fails
+ */
+int transferChain(uint16_t block, uint32_t offset, uint8_t *buf, uint32_t length, bool writing, fat *fat, uint16_t *lastBlock, uint32_t *links);
+
+/**
+ * @brief      Gets the number of blocks in the root directory file's chain, which always starts at block 1
+ *
+ * @param      fat   The FAT
+ *
+ * @return     The number of blocks in the chain
+ */
+uint32_t getDirectoryBlockCount(fat *fat);
+
+/**
+ * @brief      Reads the root directory file's whole chain into an array of directory entries in a single pass
+ *
+ * @param      records  Array with room for getDirectoryBlockCount(fat) blocks worth of entries
+ * @param      fat      The FAT
+ *
+ * @return     The number of records before the first null record, FAILURE if reading fails
+ */
+int readDirectoryRecords(directoryEntry *records, fat *fat);
+
 /**
  * @brief      Helper function to get the root directory file in a FAT
  *
@@ -57,6 +113,21 @@ file *getDirectoryFile(fat *fat);
  */
 uint8_t *getBytes(uint16_t startIndex, uint32_t length, fat *fat);
 
+/**
+ * @brief      Reads up to length bytes of a file starting at a byte offset, only touching the blocks that
+ *             hold the requested bytes
+ *
+ * @param      entry   The directory entry of the file to read
+ * @param[in]  offset  The byte offset within the file to start reading at
+ * @param[in]  length  The maximum number of bytes to read
+ * @param      buf     The buffer to read into, must hold at least length bytes
+ * @param      fat     The FAT
+ * @param      cursor  The cursor cached for this file to start the chain walk from, NULL if unused
+ *
+ * @return     The number of bytes read, 0 if offset is at or past the end of the file, or FAILURE (-1) on error
+ */
+int readBytesFromFAT(directoryEntry *entry, uint32_t offset, uint32_t length, uint8_t *buf, fat *fat, fileCursor *cursor);
+
 /**
  * @brief      Reads a file as byte pointers
  *
@@ -102,11 +173,11 @@ int renameFile(char *oldFileName, char *newFileName, fat *fat);
  * @param      fat        The FAT filesystem
  * @param      appending  Whether or not to append to the file
  * @param      syscall    Whether or not this call is allowed to modify files no matter the permissions
- * @param      writeDir   Only used with system calls -- allows writing to the directory file
+ * @param      cursor     The cursor cached for this file to start the chain walk from, NULL if unused
  *
  * @return     -1 (FAILURE) on failure, 0 (SUCCESS) on success
  */
-int writeFileToFAT(char *fileName, uint8_t *bytes, uint32_t offset, uint32_t length, uint8_t type, uint8_t perm, fat *fat, bool appending, bool syscall, bool writeDir);
+int writeFileToFAT(char *fileName, uint8_t *bytes, uint32_t offset, uint32_t length, uint8_t type, uint8_t perm, fat *fat, bool appending, bool syscall, fileCursor *cursor);
 
 /**
  * @brief      Appends to file in a FAT filesystem.
@@ -116,13 +187,15 @@ int writeFileToFAT(char *fileName, uint8_t *bytes, uint32_t offset, uint32_t len
  * @param[in]  length    The number of bytes to append
  * @param      fat       The FAT filesystem
  * @param      syscall   Whether or not this call is allowed to modify files no matter the permissions
+ * @param      cursor    The cursor cached for this file to start the chain walk from, NULL if unused
  *
  * @return     -1 (FAILURE) on failure, 0 (SUCCESS) on success
  */
-int appendToFileInFAT(char *fileName, uint8_t *bytes, uint32_t length, fat *fat, bool syscall);
+int appendToFileInFAT(char *fileName, uint8_t *bytes, uint32_t length, fat *fat, bool syscall, fileCursor *cursor);
 
 /**
- * @brief      Writes the directory file
+ * @brief      Writes the directory file, rewriting only the records of entries marked dirty and growing, shrinking
+ *             and terminating the directory chain when the number of files changed
  *
  * @param      fat   The FAT filesystem
  *
@@ -19,6 +19,17 @@
 #define PENNFAT_PROMPT_LENGTH 9
 
 #define DIRECTORY_FILENAME "/"
+#define NAME_INDEX_MIN_SIZE 64
+#define DIRECTORY_SLOTS_MIN_SIZE 64
+#define DIRECTORY_SLAB_SIZE 64
+#define FREE_RUN_SEARCH_LIMIT 512
+#define PID_INDEX_MIN_SIZE 64
+#define SLEEP_HEAP_MIN_SIZE 64
+#define STACK_SIZE (64 * 1024)
+#define STACK_POOL_SIZE 64
+#define TERMINAL_BUFFER_SIZE 4096
+#define PIPE_BUFFER_SIZE 4096
+#define FD_TABLE_SIZE 32
 
 #define UNKNOWN_FILETYPE 0
 #define REGULAR_FILETYPE 1
@@ -52,3 +63,30 @@
 #define SIGNALED 3
 #define EXITED 4
 #define QUANTUM 100
+#define HIGH_SHARE 9
+#define MED_SHARE 6
+#define LOW_SHARE 4
+#define STRIDE_BASE (1 << 20)
+#define MIN_QUANTUM 1
+#define MAX_QUANTUM 10000
+
+// Number of virtual CPUs, each a host thread running its own scheduler loop
+#ifndef SMP_CPUS
+#define SMP_CPUS 1
+#endif
+
+// Stop the periodic clock tick while PennOS is idle and catch up on wake up. The
+// clock is shared by all CPUs, so it only stops on a uniprocessor
+#ifndef TICKLESS_IDLE
+#define TICKLESS_IDLE 1
+#endif
+#if SMP_CPUS > 1
+#undef TICKLESS_IDLE
+#define TICKLESS_IDLE 0
+#endif
+
+// Bytes of small writes a file descriptor gathers before writing them to the file
+// system in one go, 0 to write through on every f_write
+#ifndef FD_WRITE_BUFFER_SIZE
+#define FD_WRITE_BUFFER_SIZE 4096
+#endif
@@ -10,6 +10,7 @@
 #include "../fs/fat.h"
 #include "pennfathandler.h"
 #include "../fs/file.h"
+#include "../fs/blockdev.h"
 #include "../include/macros.h"
 
 int handlePennFatCommand(char ***commands, int commandCount, fat **fat) {
@@ -49,6 +50,13 @@ int handlePennFatCommand(char ***commands, int commandCount, fat **fat) {
         printf("NumEntries: %d\n", (*fat)->numEntries);
         printf("FileCount : %d\n", (*fat)->fileCount);
         printf("FreeBlocks: %d\n", (*fat)->freeBlocks);
+        if ((*fat)->cache != NULL) {
+            blockCache *cache = (*fat)->cache;
+            printf("CacheSlots: %d/%d\n", cache->used, cache->capacity);
+            printf("CacheStats: %llu hits, %llu misses, %llu writebacks\n",
+                (unsigned long long) cache->hits, (unsigned long long) cache->misses,
+                (unsigned long long) cache->writebacks);
+        }
     } else {
         printf("%s not recognized\n", commands[0][0]);
     }
@@ -103,7 +111,7 @@ int handleTouchCommand(char **files, fat *fat) {
     int idx = 1;
     char *fileName = files[idx];
     while (fileName != NULL) {
-        if (writeFileToFAT(fileName, NULL, 0, 0, REGULAR_FILETYPE, READWRITE_PERMS, fat, true, false, false) == FAILURE)
+        if (writeFileToFAT(fileName, NULL, 0, 0, REGULAR_FILETYPE, READWRITE_PERMS, fat, true, false, NULL) == FAILURE)
             return FAILURE;
         fileName = files[++idx];
     }
@@ -209,7 +217,7 @@ int handleCatCommand(char **commands, fat *fat) {
 
         // write line to file, appending if necessary
         printf("writing a file\n");
-        if (writeFileToFAT(commands[2], (uint8_t*) line, 0, n, REGULAR_FILETYPE, READWRITE_PERMS, fat, appending, false, false) == FAILURE) {
+        if (writeFileToFAT(commands[2], (uint8_t*) line, 0, n, REGULAR_FILETYPE, READWRITE_PERMS, fat, appending, false, NULL) == FAILURE) {
             free(line);
             return FAILURE;
         }
@@ -244,11 +252,11 @@ int handleCatCommand(char **commands, fat *fat) {
                 printf("%s", (char*)files[i]->bytes);
             else if (i == 0 && writing) {
                 printf("writing 1\n");
-                if (writeFileToFAT(commands[count - 1], files[i]->bytes, 0, files[i]->len, REGULAR_FILETYPE, READWRITE_PERMS, fat, false, false, false) == FAILURE)
+                if (writeFileToFAT(commands[count - 1], files[i]->bytes, 0, files[i]->len, REGULAR_FILETYPE, READWRITE_PERMS, fat, false, false, NULL) == FAILURE)
                     return FAILURE;
             } else {
                 printf("writing 2\n");
-                if (writeFileToFAT(commands[count - 1], files[i]->bytes, 0, files[i]->len, REGULAR_FILETYPE, READWRITE_PERMS, fat, true, false, false) == FAILURE)
+                if (writeFileToFAT(commands[count - 1], files[i]->bytes, 0, files[i]->len, REGULAR_FILETYPE, READWRITE_PERMS, fat, true, false, NULL) == FAILURE)
                     return FAILURE;
             }
             freeFile(files[i]);
@@ -330,7 +338,7 @@ int handleCopyCommand(char **commands, fat *fat) {
 
         // if the file is empty, just create an empty file
         if (size == 0) {
-            if (writeFileToFAT(commands[3], NULL, 0, size, REGULAR_FILETYPE, READWRITE_PERMS, fat, false, false, false) == FAILURE) {
+            if (writeFileToFAT(commands[3], NULL, 0, size, REGULAR_FILETYPE, READWRITE_PERMS, fat, false, false, NULL) == FAILURE) {
                 printf("Failed to copy host file %s to %s\n", commands[2], commands[3]);
                 return FAILURE;
             }
@@ -367,7 +375,7 @@ int handleCopyCommand(char **commands, fat *fat) {
         }
 
         // write the file to the FAT
-        if (writeFileToFAT(commands[3], buf, 0, size, REGULAR_FILETYPE, READWRITE_PERMS, fat, false, false, false) == FAILURE) {
+        if (writeFileToFAT(commands[3], buf, 0, size, REGULAR_FILETYPE, READWRITE_PERMS, fat, false, false, NULL) == FAILURE) {
             printf("Failed to copy host file %s to %s\n", commands[2], commands[3]);
             free(buf);
             return FAILURE;
@@ -390,12 +398,15 @@ int handleCopyCommand(char **commands, fat *fat) {
             return FAILURE;
         }
 
-        // write each byte to the file on the host
-        for (int i = 0; i < file->len; i++) {
-            if (write(fd, &file->bytes[i], sizeof(uint8_t)) == -1) {
+        // write the whole file to the host, retrying in case of short writes
+        unsigned int bytesWritten = 0;
+        while (bytesWritten < file->len) {
+            ssize_t res = write(fd, &file->bytes[bytesWritten], file->len - bytesWritten);
+            if (res == -1) {
                 perror("write");
                 return FAILURE;
             }
+            bytesWritten += res;
         }
 
         if (close(fd) == -1) {
@@ -411,7 +422,7 @@ int handleCopyCommand(char **commands, fat *fat) {
         if (file == NULL)
             return FAILURE;
 
-        if (writeFileToFAT(commands[2], file->bytes, 0, file->len, REGULAR_FILETYPE, READWRITE_PERMS, fat, false, false, false) == FAILURE) {
+        if (writeFileToFAT(commands[2], file->bytes, 0, file->len, REGULAR_FILETYPE, READWRITE_PERMS, fat, false, false, NULL) == FAILURE) {
             return FAILURE;
         }
 
@@ -1,43 +1,56 @@
 #ifndef PCB_HEADER
 #define PCB_HEADER
 
-#include <ucontext.h>
+#include "context.h"
+#include "queue.h"
+#include "../include/macros.h"
 #include <sys/types.h>
 #include <stdbool.h>
 
+struct fileDescriptorNodeType;
+
 /**
  * @file PCB.h
  * @brief Defines a PCB type
  */
 
-/**
- * Process Control Block child object
- */
-typedef struct childTag {
-    pid_t pid;
-    struct childTag *prev;
-    struct childTag *next;
-} child;
-
 /**
  * A process control block, which is used by the kernel to context switch to and
  * from a particular process, send signals to a process or process group, etc.
+ *
+ * Every list a process can be on links it through a node embedded here, so putting
+ * a process on or taking it off a list never allocates
  */
 typedef struct pcbType {
-    ucontext_t context; // The context of this process
+    context_t context; // The context of this process
+    stack_t stack; // The pooled stack this process runs on
     int status; // The status of this process (READY, BLOCKED, STOPPED, SIGNALED, EXITED)
-    int prevStatus; // The previous state of this process
     int priority_level; // The priority level of this process (HIGH (-1), MEDIUM (0), LOW(1))
     pid_t pid; // The process ID
     pid_t ppid; // The parent process group ID
     pid_t pgid; // The process group ID
-    int ticksLeft; // The number of ticks left for a sleep process, -1 for other processes
+    int ticksLeft; // The number of ticks left for a sleep process when it was last armed or stopped, -1 for other processes
+    int wakeTick; // The absolute tick at which an armed sleep process wakes
+    int sleepIndex; // The position of this process in the sleep heap, -1 when not armed
     bool waitedOn; // Whether this process has been waited on
-    child *child_pids; // The children of this process
-    child *zombies; // The zombie children of this process
+    queue children; // The children of this process, linked through their siblingNode
+    queue childEvents; // The children with a stop or exit not yet waited on, linked through their eventNode, oldest first
+    queue childWait; // The wait queue this process blocks on in p_waitpid until a child posts an event
     char *name; // The name of this process
-    int stdin; // The file descriptor mapped to stdin for this process
-    int stdout; // The file descriptor mapped to stdout for this process
+    struct fileDescriptorNodeType *fds[FD_TABLE_SIZE]; // The open files of this process indexed by file descriptor, NULL for a free slot. 0 is stdin and 1 is stdout
+    node tableNode; // The node linking this process into the process table and pid index, or the free PCB list once reaped
+    node runNode; // The node linking this process into a scheduler run queue
+    bool runnable; // Whether runNode is currently in a run queue (only while READY)
+    node siblingNode; // The node linking this process into its parent's children
+    node eventNode; // The node linking this process into its parent's childEvents
+    bool eventPosted; // Whether eventNode is currently in the parent's childEvents
+    int eventStatus; // The status posted to the parent (STOPPED, SIGNALED, EXITED)
+    node waitNode; // The node linking this process into the wait queue it is BLOCKED on
+    queue *waitingOn; // The wait queue waitNode is in, NULL when the process is not waiting on one
+    int cpu; // The virtual CPU whose run queue holds this process, which is the one it last ran on
+    int lockDepth; // The kernel lock depth this process was switched out at, restored when it resumes
+    void (*entry)(); // The function this process runs
+    long long pass; // The stride policy's measure of the CPU time this process has been given
 } pcb_t;
 
 #endif
\ No newline at end of file
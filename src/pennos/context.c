@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "context.h"
+
+#if CONTEXT_ASM
+
+/*
+ * contextSwap(save, load) pushes the callee-saved registers and the SSE and x87
+ * control words, stores the stack pointer in *save, then loads load as the
+ * stack pointer and pops the same frame from it. A fresh frame built by
+ * contextReset "returns" into contextTrampoline with the context in r12
+ */
+void contextSwap(void **save, void *load);
+void contextTrampoline();
+
+__asm__(
+    ".text\n"
+    ".globl contextSwap\n"
+    ".type contextSwap, @function\n"
+    "contextSwap:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size contextSwap, .-contextSwap\n"
+    ".globl contextTrampoline\n"
+    ".type contextTrampoline, @function\n"
+    "contextTrampoline:\n"
+    "    movq %r12, %rdi\n"
+    "    call contextEntry@PLT\n"
+    "    ud2\n"
+    ".size contextTrampoline, .-contextTrampoline\n"
+);
+
+// the stack pointer of a context that is abandoned rather than saved
+void *discardedSp;
+
+/**
+ * @brief      Runs the entry function of a fresh context, then restarts its link
+ *
+ * @param      ctx   The context that was started
+ */
+void contextEntry(context_t *ctx) {
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+
+    ctx->func(ctx->argv);
+
+    contextRestart(ctx->link);
+}
+
+/**
+ * @brief      Blocks every signal, so a resume is not interrupted halfway
+ */
+void blockAllSignals() {
+    sigset_t all;
+    sigfillset(&all);
+    sigprocmask(SIG_SETMASK, &all, NULL);
+}
+
+void contextMake(context_t *ctx, stack_t *stack, void (*func)(), char *argv[], context_t *link) {
+    ctx->func = func;
+    ctx->argv = argv;
+    ctx->link = link;
+    ctx->stack = *stack;
+    contextReset(ctx);
+}
+
+void contextReset(context_t *ctx) {
+    // the frame contextSwap pops: control words, r15, r14, r13, r12, rbx, rbp and
+    // the return address, ending 16-byte aligned below the top of the stack
+    uintptr_t top = ((uintptr_t) ctx->stack.ss_sp + ctx->stack.ss_size) & ~(uintptr_t) 15;
+    uint64_t *frame = (uint64_t *) (top - 16 - 8 * sizeof(uint64_t));
+
+    frame[0] = 0x1F80 | ((uint64_t) 0x037F << 32);
+    frame[1] = 0;
+    frame[2] = 0;
+    frame[3] = 0;
+    frame[4] = (uint64_t) (uintptr_t) ctx;
+    frame[5] = 0;
+    frame[6] = 0;
+    frame[7] = (uint64_t) (uintptr_t) contextTrampoline;
+    ctx->sp = frame;
+}
+
+void contextSwitch(context_t *from, context_t *to) {
+    contextSwap(&from->sp, to->sp);
+}
+
+void contextResume(context_t *ctx) {
+    blockAllSignals();
+    contextSwap(&discardedSp, ctx->sp);
+}
+
+void contextRestart(context_t *ctx) {
+    blockAllSignals();
+    contextReset(ctx);
+    contextSwap(&discardedSp, ctx->sp);
+}
+
+#else
+
+void contextMake(context_t *ctx, stack_t *stack, void (*func)(), char *argv[], context_t *link) {
+    getcontext(ctx);
+    sigemptyset(&ctx->uc_sigmask);
+    ctx->uc_stack = *stack;
+    ctx->uc_link = link;
+    makecontext(ctx, func, 1, argv);
+}
+
+void contextSwitch(context_t *from, context_t *to) {
+    swapcontext(from, to);
+}
+
+void contextResume(context_t *ctx) {
+    setcontext(ctx);
+}
+
+void contextReset(context_t *ctx) {
+    // a ucontext that is never saved into restarts at its entry point every time
+}
+
+void contextRestart(context_t *ctx) {
+    setcontext(ctx);
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef CONTEXT_HEADER
+#define CONTEXT_HEADER
+
+#include <signal.h>
+#include <ucontext.h>
+
+/**
+ * @file context.h
+ * @brief Defines the execution contexts the kernel switches between
+ *
+ * There are two backends. The default one wraps ucontext, which saves and
+ * restores the signal mask (one rt_sigprocmask syscall) on every switch. Building
+ * with FAST_CONTEXT_SWITCH=1 on x86-64 selects a backend that saves only the
+ * callee-saved registers and the stack pointer. It leaves the signal mask alone,
+ * so callers must keep signals blocked around a switch. A tick's signal handler
+ * already runs with them blocked, and sigreturn restores the mask when the
+ * preempted process resumes.
+ */
+
+#ifndef FAST_CONTEXT_SWITCH
+#define FAST_CONTEXT_SWITCH 0
+#endif
+
+#if FAST_CONTEXT_SWITCH && defined(__x86_64__)
+#define CONTEXT_ASM 1
+#else
+#define CONTEXT_ASM 0
+#endif
+
+#if CONTEXT_ASM
+
+/**
+ * A register-only context. While switched out, all callee-saved registers are
+ * stored on its own stack and sp points at them
+ */
+typedef struct contextTag {
+    void *sp; // The saved stack pointer
+    void (*func)(); // The entry function
+    char **argv; // The argument passed to func
+    struct contextTag *link; // The context restarted when func returns
+    stack_t stack; // The stack the context runs on
+} context_t;
+
+#else
+
+typedef ucontext_t context_t;
+
+#endif
+
+/**
+ * Creates a context that runs func(argv) on stack, and restarts link when func
+ * returns. The context starts with no signals blocked
+ * @param ctx the context to create
+ * @param stack the stack to run on
+ * @param func the entry function
+ * @param argv the argument passed to func
+ * @param link the context to restart when func returns
+ */
+void contextMake(context_t *ctx, stack_t *stack, void (*func)(), char *argv[], context_t *link);
+
+/**
+ * Saves the running context into from and resumes to. Returns when from is resumed
+ * @param from the context to save into
+ * @param to the context to resume
+ */
+void contextSwitch(context_t *from, context_t *to);
+
+/**
+ * Resumes a context without saving the running one
+ * @param ctx the context to resume
+ */
+void contextResume(context_t *ctx);
+
+/**
+ * Rewinds a context created by contextMake to its entry point, so the next
+ * switch to it starts func again. Needed for contexts that are only ever
+ * entered, like the scheduler and idle contexts
+ * @param ctx the context to rewind
+ */
+void contextReset(context_t *ctx);
+
+/**
+ * Rewinds a context to its entry point and resumes it, discarding the running one
+ * @param ctx the context to restart
+ */
+void contextRestart(context_t *ctx);
+
+#endif
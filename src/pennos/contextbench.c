@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "context.h"
+#include "stackpool.h"
+
+/**
+ * @file contextbench.c
+ * @brief Measures context switches per second for the backend selected at build time
+ */
+
+#define BENCH_SWITCHES 2000000
+
+context_t benchMain;
+context_t ping;
+context_t pong;
+long switches = 0;
+
+/**
+ * @brief      Switches to pong until the switch budget is used up, then returns to main
+ */
+void pingLoop() {
+    while (switches < BENCH_SWITCHES) {
+        switches++;
+        contextSwitch(&ping, &pong);
+    }
+    contextResume(&benchMain);
+}
+
+/**
+ * @brief      Switches straight back to ping forever
+ */
+void pongLoop() {
+    while (1) {
+        switches++;
+        contextSwitch(&pong, &ping);
+    }
+}
+
+int main() {
+    stack_t pingStack;
+    stack_t pongStack;
+    if (stackPoolAlloc(&pingStack, 0) == -1 || stackPoolAlloc(&pongStack, 0) == -1) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    contextMake(&ping, &pingStack, pingLoop, NULL, &benchMain);
+    contextMake(&pong, &pongStack, pongLoop, NULL, &benchMain);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    contextSwitch(&benchMain, &ping);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s: %ld switches in %.3f s, %.0f switches/s\n", CONTEXT_ASM ? "register" : "ucontext",
+           switches, seconds, switches / seconds);
+    return 0;
+}
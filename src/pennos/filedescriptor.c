@@ -9,6 +9,36 @@
 #include "../include/macros.h"
 #include "user_level_funcs.h"
 
+/**
+ * @brief      Allocates an open file with a single reference, not yet on any entry
+ *
+ * @param[in]  mode  The mode for the open file
+ *
+ * @return     Pointer to the new open file, or NULL if it failed
+ */
+fdNode *allocFdNode(int mode) {
+    fdNode *newNode = malloc(sizeof(fdNode));
+
+    if (newNode == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    newNode->entry = NULL;
+    newNode->entryNode = NULL;
+    newNode->pipe = NULL;
+    newNode->refs = 1;
+    newNode->writeBuffer = NULL;
+    newNode->buffered = 0;
+    newNode->mode = mode;
+    newNode->pos = 0;
+    resetFileCursor(&newNode->cursor);
+    newNode->prev = NULL;
+    newNode->next = NULL;
+
+    return newNode;
+}
+
 fdContainer *newContainer() {
     fdContainer *out = malloc(sizeof(fdContainer));
 
@@ -17,62 +47,63 @@ fdContainer *newContainer() {
         return NULL;
     }
 
-    out->firstFdNode = NULL;
-    out->lastFdNode = NULL;
+    // the container's reference keeps the terminal open however often processes close it
+    out->terminalIn = allocFdNode(F_READ);
+    out->terminalOut = allocFdNode(F_WRITE);
+    if (out->terminalIn == NULL || out->terminalOut == NULL) {
+        free(out->terminalIn);
+        free(out->terminalOut);
+        free(out);
+        return NULL;
+    }
 
     return out;
 }
 
-/**
- * @brief      Creates and adds a new file descriptor with specified filename and node and assigns an id
- *
- * @param      fileName   The file name for the descriptor
- * @param[in]  mode       The mode for the descriptor
- *
- * @return     Pointer to the new file descriptor node, or NULL if it failed
- */
-fdNode *newFileDescriptorNode(char *fileName, int mode, directoryEntry *entry) {
-    fdNode *newNode = malloc(sizeof(fdNode));
+fdNode *newFileDescriptorNode(directoryEntryNode *entryNode, int mode) {
+    fdNode *newNode = allocFdNode(mode);
 
     if (newNode == NULL) {
-        perror("malloc");
         return NULL;
     }
 
-    newNode->entry = entry;
-
-    newNode->id = 3;
-    newNode->mode = mode;
+    newNode->entry = entryNode->entry;
+    newNode->entryNode = entryNode;
     if (mode == F_APPEND)
-        newNode->pos = entry->size;
-    else
-        newNode->pos = 0;
-    newNode->next = NULL;
+        newNode->pos = entryNode->entry->size;
 
-    if (container->firstFdNode == NULL) {
-        container->firstFdNode = newNode;
-        container->lastFdNode = newNode;
-    } else {
-        newNode->id = container->lastFdNode->id + 1;
-        container->lastFdNode->next = newNode;
-        container->lastFdNode = newNode;
+    newNode->next = entryNode->openFiles;
+    if (entryNode->openFiles != NULL)
+        entryNode->openFiles->prev = newNode;
+    entryNode->openFiles = newNode;
+
+    return newNode;
+}
+
+fdNode *newPipeDescriptorNode(pipeBuffer *pipe, int mode) {
+    fdNode *newNode = allocFdNode(mode);
+
+    if (newNode == NULL) {
+        return NULL;
     }
 
+    newNode->pipe = pipe;
+
     return newNode;
 }
 
 /**
- * @brief      Finds a file descriptor node with the given filename, if it exists
+ * @brief      Finds an open file on a directory entry in either F_WRITE or F_APPEND, if it exists
  *
- * @param      fileName   The file name
+ * @param      entryNode  The node of the directory entry
  *
- * @return     Pointer to the file descriptor node, or NULL if it doesn't exist
+ * @return     Pointer to the open file, or NULL if it doesn't exist
  */
-fdNode *findFdNodeWithFileName(char *fileName) {
-    fdNode *found = container->firstFdNode;
+fdNode *findWritingFdNode(directoryEntryNode *entryNode) {
+    fdNode *found = entryNode->openFiles;
 
-    while (found != NULL && found->entry != NULL) {
-        if (strcmp(fileName, found->entry->name) == 0)
+    while (found != NULL) {
+        if (found->mode == F_WRITE || found->mode == F_APPEND)
             return found;
         found = found->next;
     }
@@ -81,96 +112,206 @@ fdNode *findFdNodeWithFileName(char *fileName) {
 }
 
 /**
- * @brief      Finds a file descriptor node with the given filename in either F_WRITE or F_APPEND, if it exists
- *
- * @param      fileName  The file name
+ * @brief      Invalidates the cached cursors of every file descriptor open on an entry, used whenever the entry's
+ *             block chain is freed or replaced
  *
- * @return     Pointer to the file descriptor node, or NULL if it doesn't exist
+ * @param      entryNode  The node of the directory entry
  */
-fdNode *findWritingFdNodeWithFileName(char *fileName) {
-    fdNode *found = container->firstFdNode;
+void invalidateCursors(directoryEntryNode *entryNode) {
+    for (fdNode *node = entryNode->openFiles; node != NULL; node = node->next)
+        resetFileCursor(&node->cursor);
+}
 
-    while (found != NULL) {
-        if ((found->mode == F_WRITE || found->mode == F_APPEND) && found->entry != NULL && strcmp(fileName, found->entry->name) == 0)
-            return found;
-        found = found->next;
+/**
+ * @brief      Detaches every file descriptor open on an entry that was deleted or replaced. The entry's node is
+ *             recycled for the next file created, so the descriptors drop their buffered writes and fail any
+ *             later reads or writes instead of reaching that file
+ *
+ * @param      entryNode  The node of the directory entry
+ */
+void detachDescriptors(directoryEntryNode *entryNode) {
+    fdNode *node = entryNode->openFiles;
+    entryNode->openFiles = NULL;
+
+    while (node != NULL) {
+        fdNode *next = node->next;
+        node->entry = NULL;
+        node->entryNode = NULL;
+        node->prev = NULL;
+        node->next = NULL;
+        node->buffered = 0;
+        resetFileCursor(&node->cursor);
+        node = next;
     }
+}
 
-    return found;
+/**
+ * @brief      Writes bytes to the file system for a file descriptor, at offset in F_WRITE mode or at the end
+ *             of the file in F_APPEND mode
+ *
+ * @param      node    The file descriptor node
+ * @param      buf     The bytes to write
+ * @param[in]  offset  The offset to write at in F_WRITE mode
+ * @param[in]  n       The number of bytes to write
+ *
+ * @return     SUCCESS (0) on success, FAILURE (-1) on failure
+ */
+int commitWrite(fdNode *node, uint8_t *buf, int offset, int n) {
+    directoryEntry *entry = node->entry;
+
+    if (node->mode == F_APPEND)
+        return appendToFileInFAT(entry->name, buf, n, mountedFat, false, &node->cursor);
+
+    // writing at position 0 replaces the file's chain
+    if (offset == 0)
+        invalidateCursors(node->entryNode);
 
+    // the entry already has the type and permissions, so the file is never read back to find them
+    return writeFileToFAT(entry->name, buf, offset, n, entry->type, entry->perm, mountedFat, false, false, &node->cursor);
 }
 
 /**
- * @brief      Finds a file descriptor node with the given filename and the given mode, if it exists
+ * @brief      Writes the bytes buffered on a file descriptor to the file system
  *
- * @param      fileName   The file name
- * @param[in]  mode       The mode
+ * @param      node  The file descriptor node
  *
- * @return     Pointer to the file descriptor node, or NULL if it doesn't exist
+ * @return     SUCCESS (0) on success, FAILURE (-1) on failure
  */
-fdNode *findFdNodeWithFileNameAndMode(char *fileName, int mode) {
-    fdNode *found = container->firstFdNode;
+int flushWrites(fdNode *node) {
+    if (node->buffered == 0)
+        return SUCCESS;
 
-    while (found != NULL) {
-        if (found->mode == mode && found->entry != NULL && strcmp(fileName, found->entry->name) == 0)
-            return found;
-        found = found->next;
+    int n = node->buffered;
+    node->buffered = 0;
+
+    if (commitWrite(node, node->writeBuffer, node->pos - n, n) == FAILURE)
+        return FAILURE;
+
+    if (node->mode == F_APPEND)
+        node->pos = node->entry->size;
+
+    return SUCCESS;
+}
+
+int fdInstall(pcb_t *process, fdNode *file) {
+    for (int fd = 0; fd < FD_TABLE_SIZE; fd++) {
+        if (process->fds[fd] == NULL) {
+            process->fds[fd] = file;
+            return fd;
+        }
     }
 
-    return found;
+    printf("Too many open files\n");
+    return FAILURE;
+}
+
+fdNode *fdLookup(pcb_t *process, int fd) {
+    if (process == NULL || fd < 0 || fd >= FD_TABLE_SIZE)
+        return NULL;
+
+    return process->fds[fd];
+}
+
+void fdSet(pcb_t *process, int fd, fdNode *file) {
+    // the new reference is taken first, in case the slot already holds this file
+    file->refs++;
+    fdNode *old = process->fds[fd];
+    process->fds[fd] = file;
+
+    if (old != NULL)
+        fdRelease(old);
+}
+
+void fdRelease(fdNode *file) {
+    file->refs--;
+    if (file->refs > 0)
+        return;
+
+    if (file->entry != NULL)
+        flushWrites(file);
+
+    if (file->entryNode != NULL) {
+        if (file->prev == NULL)
+            file->entryNode->openFiles = file->next;
+        else
+            file->prev->next = file->next;
+
+        if (file->next != NULL)
+            file->next->prev = file->prev;
+    }
+
+    pipeBuffer *pipe = file->pipe;
+    bool writeEnd = file->mode == F_WRITE;
+    free(file->writeBuffer);
+    free(file);
+
+    if (pipe != NULL) {
+        pipeClose(pipe, writeEnd);
+        return;
+    }
+
+    saveFat(mountedFat);
+}
+
+void fdCloseAll(pcb_t *process) {
+    for (int fd = 0; fd < FD_TABLE_SIZE; fd++) {
+        if (process->fds[fd] != NULL) {
+            fdNode *file = process->fds[fd];
+            process->fds[fd] = NULL;
+            fdRelease(file);
+        }
+    }
 }
 
 /**
- * @brief      Finds the file descriptor with the given id, if it exists
+ * @brief      Gives a newly opened file the lowest free descriptor of the calling process
  *
- * @param[in]  id         The identifier
+ * @param      newFd  The open file, or NULL if opening it failed
+ * @param      fname  The file name
  *
- * @return     Pointer to the file descriptor node, or NULL if it doesn't exist
+ * @return     The file descriptor, or FAILURE (-1) if it failed
  */
-fdNode *findFdNodeWithId(int id) {
-    fdNode *found = container->firstFdNode;
-
-    while (found != NULL) {
-        if (found->id == id)
-            return found;
-        found = found->next;
+int installOpenFile(fdNode *newFd, char *fname) {
+    if (newFd == NULL) {
+        printf("Failed to open fd for %s\n", fname);
+        return FAILURE;
     }
 
-    return found;
+    int fd = fdInstall(getCurrProcess(), newFd);
+    if (fd == FAILURE)
+        fdRelease(newFd);
+
+    return fd;
 }
 
 int f_open(char* fname, int mode) {
+    KERNEL_ENTER;
     if (mode == F_WRITE || mode == F_APPEND) {
-        if (findWritingFdNodeWithFileName(fname) != NULL) {
+        directoryEntryNode *entryNode;
+        getEntryNodeAndPrev(NULL, &entryNode, fname, mountedFat);
+
+        if (entryNode != NULL && findWritingFdNode(entryNode) != NULL) {
             printf("%s already open for writing\n", fname);
             return FAILURE;
         }
 
-        directoryEntryNode *entryNode;
-        getEntryNodeAndPrev(NULL, &entryNode, fname, mountedFat);
-
         // create the file if it doesn't exist
         if (entryNode == NULL) {
-            if (writeFileToFAT(fname, NULL, 0, 0, REGULAR_FILETYPE, READWRITE_PERMS, mountedFat, false, false, false) == FAILURE) {
+            if (writeFileToFAT(fname, NULL, 0, 0, REGULAR_FILETYPE, READWRITE_PERMS, mountedFat, false, false, NULL) == FAILURE) {
                 printf("Failed to create %s\n", fname);
                 return FAILURE;
             }
             getEntryNodeAndPrev(NULL, &entryNode, fname, mountedFat);
-        } else if (F_WRITE) {
+        } else if (mode == F_WRITE) {
             // truncate the file if we are in F_WRITE mode
-            if (writeFileToFAT(fname, NULL, 0, 0, entryNode->entry->type,entryNode->entry->perm, mountedFat, false, false, false) == FAILURE) {
+            if (writeFileToFAT(fname, NULL, 0, 0, entryNode->entry->type,entryNode->entry->perm, mountedFat, false, false, NULL) == FAILURE) {
                 printf("Failed to truncate %s\n", fname);
                 return FAILURE;
             };
+            invalidateCursors(entryNode);
         }
 
-        fdNode *newFd = newFileDescriptorNode(fname, mode, entryNode->entry);
-
-        if (newFd == NULL) {
-            printf("Failed to open fd for %s\n", fname);
-        }
-
-        return newFd->id;
+        return installOpenFile(newFileDescriptorNode(entryNode, mode), fname);
     } else if (mode == F_READ) {
         directoryEntryNode *entryNode;
         getEntryNodeAndPrev(NULL,  &entryNode, fname, mountedFat);
@@ -180,13 +321,7 @@ int f_open(char* fname, int mode) {
             return FAILURE;
         }
 
-        fdNode *newFd = newFileDescriptorNode(fname, mode, entryNode->entry);
-
-        if (newFd == NULL) {
-            printf("Failed to open fd for %s\n", fname);
-        }
-
-        return newFd->id;
+        return installOpenFile(newFileDescriptorNode(entryNode, mode), fname);
     } else {
         printf("Invalid mode\n");
         return FAILURE;
@@ -194,90 +329,111 @@ int f_open(char* fname, int mode) {
 }
 
 int f_read(int fd, int n, uint8_t *buf) {
+    KERNEL_ENTER;
+    fdNode *node = fdLookup(getCurrProcess(), fd);
+    if (node == NULL) {
+        printf("File descriptor %d not found\n", fd);
+        return FAILURE; 
+    }
 
-    if (fd == STDIN_FILENO) {
+    if (n < 0) {
+        printf("Cannot read a negative number of bytes\n");
+        return FAILURE;
+    }
+
+    if (node == container->terminalIn) {
         checkForTerminalControl();
-        int bytesRead = 0;
-        if ((bytesRead = read(fd, buf, n)) == -1) {
-            printf("Failed to read from stdin\n");
-            return FAILURE;
-        }
 
-        return bytesRead;
+        // the kernel buffers the terminal, and blocks the reader until input arrives
+        return terminalRead(buf, n);
     }
-    else {    
-        fdNode *node = findFdNodeWithId(fd);
-        if (node == NULL) {
-            printf("File descriptor %d not found\n", fd);
-            return FAILURE; 
-        }
 
-        file *f = readFileFromFAT(node->entry->name, mountedFat);
-        if (f == NULL) {
-            printf("Failed to read file\n");
+    if (node->pipe != NULL) {
+        if (node->mode != F_READ) {
+            printf("Cannot read from a write-only descriptor\n");
             return FAILURE;
         }
+        return pipeRead(node->pipe, buf, n);
+    }
 
-        if (node->pos >= f->len) {
-            // if EOF, return 0
-            return 0;
-        }
-
-        // otherwise, read at most n bytes
-        int bytesToRead = n;
-
-        if (node->pos + n > f->len) {
-            bytesToRead = f->len - node->pos;
-        }
+    if (node->entry == NULL) {
+        printf("File for descriptor %d was removed\n", fd);
+        return FAILURE;
+    }
 
-        memcpy(buf, &(f->bytes[node->pos]), bytesToRead);
+    // the descriptor's own buffered writes come before its position
+    if (flushWrites(node) == FAILURE)
+        return FAILURE;
 
-        node->pos += bytesToRead;
+    // read at most n bytes starting at the descriptor's position, 0 if EOF
+    int bytesRead = readBytesFromFAT(node->entry, node->pos, n, buf, mountedFat, &node->cursor);
+    if (bytesRead == FAILURE) {
+        printf("Failed to read file\n");
+        return FAILURE;
+    }
 
-        freeFile(f);
+    node->pos += bytesRead;
 
-        return bytesToRead;
-    }
+    return bytesRead;
 }
 
 int f_write(int fd, uint8_t *buf, int n) {
-    
-    if (fd == STDOUT_FILENO) {
+    KERNEL_ENTER;
+    fdNode *node = fdLookup(getCurrProcess(), fd);
+    if (node == NULL) {
+        printf("File descriptor %d not found\n", fd);
+        return FAILURE; 
+    }
+
+    if (node == container->terminalOut) {
         int totalBytesWritten = 0;
         int bytesWritten = 0;
-        while (totalBytesWritten < n && (bytesWritten = write(fd, &buf[totalBytesWritten], n - totalBytesWritten)) != -1) {
+        while (totalBytesWritten < n && (bytesWritten = write(STDOUT_FILENO, &buf[totalBytesWritten], n - totalBytesWritten)) != -1) {
             totalBytesWritten += bytesWritten;
         }
-        return SUCCESS;
+        return totalBytesWritten;
     } else {
-        fdNode *node = findFdNodeWithId(fd);
-        if (node == NULL) {
-            printf("File descriptor %d not found\n", fd);
-            return FAILURE; 
-        }
-
         if (node->mode == F_READ) {
             printf("Cannot write in read-only mode\n");
             return FAILURE;
         }
 
-        if (node->mode == F_WRITE) {
-            file *f = readFileFromFAT(node->entry->name, mountedFat);
+        if (node->pipe != NULL)
+            return pipeWrite(node->pipe, buf, n);
 
-            if (f == NULL)
-                return FAILURE;
+        if (node->entry == NULL) {
+            printf("File for descriptor %d was removed\n", fd);
+            return FAILURE;
+        }
 
-            if (writeFileToFAT(node->entry->name, buf, node->pos, n, f->type, f->perm, mountedFat, false, false, false) == FAILURE)
+        // small writes are gathered in the buffer, so many of them cost a single write to the file system
+        if (n > 0 && n < FD_WRITE_BUFFER_SIZE) {
+            if (n > FD_WRITE_BUFFER_SIZE - node->buffered && flushWrites(node) == FAILURE)
                 return FAILURE;
 
+            if (node->writeBuffer == NULL) {
+                node->writeBuffer = malloc(FD_WRITE_BUFFER_SIZE);
+                if (node->writeBuffer == NULL) {
+                    perror("malloc");
+                    return FAILURE;
+                }
+            }
+
+            memcpy(&node->writeBuffer[node->buffered], buf, n);
+            node->buffered += n;
             node->pos += n;
-        } else if (node->mode == F_APPEND) {
-            if (appendToFileInFAT(node->entry->name, buf, n, mountedFat, false) == FAILURE)
-                return FAILURE;
+            return n;
+        }
+
+        // a large write, or an empty one that only updates the file's time, goes straight through
+        if (flushWrites(node) == FAILURE || commitWrite(node, buf, node->pos, n) == FAILURE)
+            return FAILURE;
 
+        if (node->mode == F_APPEND)
             node->pos = node->entry->size;
-        }
-        return SUCCESS;
+        else
+            node->pos += n;
+        return n;
     }
 
 
@@ -285,35 +441,41 @@ int f_write(int fd, uint8_t *buf, int n) {
 }
 
 int f_close(int fd) {
-    // get fd and the previous node
-
-    fdNode *prev = NULL;
-    fdNode *found = container->firstFdNode;
+    KERNEL_ENTER;
+    pcb_t *process = getCurrProcess();
+    fdNode *node = fdLookup(process, fd);
 
-    while (found != NULL) {
-        if (found->id == fd)
-            break;
-        prev = found;
-        found = found->next;
+    if (node == NULL) {
+        printf("File descriptor %d not found\n", fd);
+        return FAILURE;
     }
 
-    if (found == NULL) {
+    // buffered writes reach the file system even while another slot still refers to the file
+    int result = SUCCESS;
+    if (node->entry != NULL)
+        result = flushWrites(node);
+
+    // the file itself stays open while another slot still refers to it
+    process->fds[fd] = NULL;
+    fdRelease(node);
+
+    return result;
+}
+
+int f_fsync(int fd) {
+    KERNEL_ENTER;
+    fdNode *node = fdLookup(getCurrProcess(), fd);
+
+    if (node == NULL) {
         printf("File descriptor %d not found\n", fd);
         return FAILURE;
     }
 
-    if (found == container->firstFdNode && found == container->lastFdNode) {
-        container->firstFdNode = NULL;
-        container->lastFdNode = NULL;
-    } else if (found == container->firstFdNode) {
-        container->firstFdNode = found->next;
-    } else if (found == container->lastFdNode) {
-        container->lastFdNode = prev;
-    } else {
-        prev->next = found->next;
-    }
+    if (node->entry == NULL)
+        return SUCCESS;
 
-    free(found);
+    if (flushWrites(node) == FAILURE)
+        return FAILURE;
 
     saveFat(mountedFat);
 
@@ -321,14 +483,25 @@ int f_close(int fd) {
 }
 
 int f_mv(char *src, char *dest) {
+    KERNEL_ENTER;
     if (src == NULL || dest == NULL) {
         printf("Must supply filename and new filename\n");
         return FAILURE;
     }
 
+    // dest is deleted if it already exists and is not src itself
+    directoryEntryNode *srcNode;
+    directoryEntryNode *destNode;
+    getEntryNodeAndPrev(NULL, &srcNode, src, mountedFat);
+    getEntryNodeAndPrev(NULL, &destNode, dest, mountedFat);
+    directoryEntryNode *replaced = destNode != srcNode ? destNode : NULL;
+
     if (renameFile(src, dest, mountedFat) == FAILURE)
         return FAILURE;
 
+    if (replaced != NULL)
+        detachDescriptors(replaced);
+
 
     saveFat(mountedFat);
 
@@ -336,27 +509,50 @@ int f_mv(char *src, char *dest) {
 }
 
 int f_unlink(char *fileName) {
+    KERNEL_ENTER;
+    directoryEntryNode *entryNode;
+    getEntryNodeAndPrev(NULL, &entryNode, fileName, mountedFat);
+
     if (deleteFileFromFAT(fileName, mountedFat, false) == FAILURE) {
         return FAILURE;
     }
 
+    // descriptors open on this file must not reach the next file given its entry
+    detachDescriptors(entryNode);
+
     saveFat(mountedFat);
 
     return SUCCESS;
 }
 
 int f_lseek(int fd, int offset, int whence) {
+    KERNEL_ENTER;
     if (whence != F_SEEK_CUR && whence != F_SEEK_END && whence != F_SEEK_SET) {
         printf("Invalid whence argument\n");
         return FAILURE;
     }
 
-    fdNode *node = findFdNodeWithId(fd);
+    fdNode *node = fdLookup(getCurrProcess(), fd);
 
     if (node == NULL) {
         printf("File descriptor %d not found\n", fd);
+        return FAILURE;
+    }
+
+    if (node->pipe != NULL || node == container->terminalIn || node == container->terminalOut) {
+        printf("Cannot lseek on a pipe or the terminal\n");
+        return FAILURE;
     }
 
+    if (node->entry == NULL) {
+        printf("File for descriptor %d was removed\n", fd);
+        return FAILURE;
+    }
+
+    // buffered writes land where they were made, and the size below includes them
+    if (flushWrites(node) == FAILURE)
+        return FAILURE;
+
     if (whence == F_SEEK_CUR) {
         if (node->pos + offset > node->entry->size || node->pos + offset < 0) {
             printf("Cannot lseek behind 0 or past EOF\n");
@@ -381,6 +577,7 @@ int f_lseek(int fd, int offset, int whence) {
 }
 
 void f_ls() {
+    KERNEL_ENTER;
     directoryEntryNode *entryNode = mountedFat->firstDirectoryEntryNode;
 
     while (entryNode != NULL) {
@@ -413,14 +610,14 @@ void f_ls() {
         char str[1024];
         sprintf(str, "%2s%6db%4s%3s%6s %s\n", perms, entry->size, month, day, time, entry->name);
 
-        pcb_t *currProcess = getCurrProcess();
-        f_write(currProcess->stdout, (uint8_t *) str, strlen(str));
+        f_write(STDOUT_FILENO, (uint8_t *) str, strlen(str));
 
         entryNode = entryNode->next;
     }
 }
 
 int f_chmod(char *fileName, int permission) {
+    KERNEL_ENTER;
     if (chmodFile(mountedFat, fileName, permission) == FAILURE)
         return FAILURE;
 
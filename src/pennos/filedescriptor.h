@@ -2,6 +2,9 @@
 #define FILE_DESC_H
 
 #include "../fs/fat.h"
+#include "../fs/file.h"
+#include "pipe.h"
+#include "PCB.h"
 
 /**
  * @file filedescriptor.h
@@ -9,25 +12,41 @@
  */
 
 /**
- * A file descriptor node
+ * An open file, shared by every descriptor table slot that refers to it. Slots get
+ * their own reference when a process is spawned with the file or it is duplicated,
+ * and the file is closed once the last slot lets go of it
  */
 typedef struct fileDescriptorNodeType {
-    // the id of this file descriptor
-    int id;
     directoryEntry *entry;
+    // the node holding entry, whose list of open files this is on. NULL for a pipe, the terminal or a
+    // file that was removed
+    directoryEntryNode *entryNode;
     int mode;
     int pos;
-
-    // pointer to the next file descriptor node
+    // cached block of the chain near pos, so sequential reads and writes don't re-walk the chain
+    fileCursor cursor;
+    // the pipe this is an end of, NULL for a file or the terminal
+    pipeBuffer *pipe;
+    // the number of descriptor table slots referring to this open file
+    int refs;
+    // writes not yet made to the file system, which belong just before pos. The buffer is
+    // allocated on the first small write
+    uint8_t *writeBuffer;
+    int buffered;
+
+    // pointers to the neighbouring open files on the same entry, so closing one never searches
+    struct fileDescriptorNodeType *prev;
     struct fileDescriptorNodeType *next;
 } fdNode;
 
 /**
- * Stores file descriptors
+ * Stores the open files shared by every process. Open files on a regular file are kept on
+ * their directory entry's node instead
  */
 typedef struct FileDescriptorContainerType {
-	fdNode *firstFdNode;
-	fdNode *lastFdNode;
+	// the terminal's input and output, which the container always holds a reference to
+	fdNode *terminalIn;
+	fdNode *terminalOut;
 } fdContainer;
 
 /**
@@ -36,21 +55,77 @@ typedef struct FileDescriptorContainerType {
 fdContainer *container;
 
 /**
- * @brief      Instantiate a new file descriptor container
+ * @brief      Instantiate a new file descriptor container, along with the terminal's open files
  *
  * @return     Pointer to the new container
  */
 fdContainer *newContainer();
 
 /**
- * @brief      Creates and adds a new file descriptor with specified filename and node and assigns an id
+ * @brief      Creates a new open file on a directory entry and adds it to the entry's open files, held by
+ *             its creator
  *
- * @param      fileName   The file name for the descriptor
+ * @param      entryNode  The node of the file's directory entry
  * @param[in]  mode       The mode for the descriptor
  *
- * @return     Pointer to the new file descriptor node, or NULL if it failed
+ * @return     Pointer to the new open file, or NULL if it failed
+ */
+fdNode *newFileDescriptorNode(directoryEntryNode *entryNode, int mode);
+
+/**
+ * @brief      Creates a new open file for one end of a pipe, held by its creator
+ *
+ * @param      pipe  The pipe
+ * @param[in]  mode  F_READ for the read end, F_WRITE for the write end
+ *
+ * @return     Pointer to the new open file, or NULL if it failed
+ */
+fdNode *newPipeDescriptorNode(pipeBuffer *pipe, int mode);
+
+/**
+ * @brief      Places an open file in the lowest free slot of a process's descriptor table, handing it the
+ *             caller's reference
+ *
+ * @param      process  The process
+ * @param      file     The open file
+ *
+ * @return     The file descriptor, or FAILURE (-1) if the table is full
  */
-fdNode *newFileDescriptorNode(char *fileName, int mode, directoryEntry *entry);
+int fdInstall(pcb_t *process, fdNode *file);
+
+/**
+ * @brief      Finds the open file behind a file descriptor of a process
+ *
+ * @param      process  The process
+ * @param[in]  fd       The file descriptor
+ *
+ * @return     Pointer to the open file, or NULL if the descriptor is not open
+ */
+fdNode *fdLookup(pcb_t *process, int fd);
+
+/**
+ * @brief      Points a slot of a process's descriptor table at an open file, taking a reference to it and
+ *             closing what the slot held before
+ *
+ * @param      process  The process
+ * @param[in]  fd       The file descriptor, which must be within the table
+ * @param      file     The open file
+ */
+void fdSet(pcb_t *process, int fd, fdNode *file);
+
+/**
+ * @brief      Drops a reference to an open file, closing it once no slot refers to it
+ *
+ * @param      file  The open file
+ */
+void fdRelease(fdNode *file);
+
+/**
+ * @brief      Closes every descriptor of a process, leaving its table empty
+ *
+ * @param      process  The process
+ */
+void fdCloseAll(pcb_t *process);
 
 /// System calls using file descriptor abstractions
 
@@ -60,7 +135,7 @@ fdNode *newFileDescriptorNode(char *fileName, int mode, directoryEntry *entry);
  * @param[in]  fname  The filename
  * @param[in]  mode   The mode
  *
- * @return     The ID of the file descriptor on success or FAILURE (-1) if it failed
+ * @return     The lowest free file descriptor of the calling process on success or FAILURE (-1) if it failed
  */
 int f_open(char *fname, int mode);
 
@@ -76,7 +151,8 @@ int f_open(char *fname, int mode);
 int f_read(int fd, int n, uint8_t *buf);
 
 /**
- * @brief      Write n bytes from buf into fd
+ * @brief      Write n bytes from buf into fd. Small writes to a file are gathered in the descriptor's
+ *             buffer and reach the file system once FD_WRITE_BUFFER_SIZE bytes are buffered
  *
  * @param[in]  fd    The file descriptor
  * @param      buf   The buffer to read from
@@ -95,6 +171,16 @@ int f_write(int fd, uint8_t *buf, int n);
  */
 int f_close(int fd);
 
+/**
+ * @brief      Write the bytes buffered by earlier f_write calls on fd to the file system. f_close,
+ *             f_lseek and f_read on the descriptor do so as well
+ *
+ * @param[in]  fd    The file descriptor
+ *
+ * @return     SUCCESS (0) on success, FAILURE (-1) on failure
+ */
+int f_fsync(int fd);
+
 /**
  * @brief      Rename the src file to dest
  *
@@ -8,10 +8,85 @@
 #include "handlejob.h"
 #include "../include/parsejob.h"
 #include "shell.h"
+#include "filedescriptor.h"
+#include "../include/macros.h"
 
 
 #include "token.h"
 
+/**
+ * @brief      Finds the function a builtin that runs as its own process is started with
+ *
+ * @param      key   The name of the command
+ *
+ * @return     The function, or NULL if there is no such command
+ */
+void (*findSpawnedCommand(char *key))() {
+    if (strcmp(key, "sleep") == 0) {
+        return createSleep;
+    } else if (strcmp(key, "zombify") == 0) {
+        return zombify;
+    } else if (strcmp(key, "orphanify") == 0) {
+        return orphanify;
+    } else if (strcmp(key, "busy") == 0) {
+        return busy;
+    } else if (strcmp(key, "ps") == 0) {
+        return ps;
+    } else if (strcmp(key, "kill") == 0) {
+        return killer;
+    } else if (strcmp(key, "head") == 0) {
+        return head;
+    } else if (strcmp(key, "ls") == 0) {
+        return ls;
+    } else if (strcmp(key, "cachestat") == 0) {
+        return cachestat;
+    } else if (strcmp(key, "touch") == 0) {
+        return touch;
+    } else if (strcmp(key, "mv") == 0) {
+        return mv;
+    } else if (strcmp(key, "cp") == 0) {
+        return cp;
+    } else if (strcmp(key, "rm") == 0) {
+        return rm;
+    } else if (strcmp(key, "cat") == 0) {
+        return cat;
+    } else if (strcmp(key, "chmod") == 0) {
+        return chmod;
+    }
+    return NULL;
+}
+
+bool isSpawnableJob(char ***commands, int commandCount) {
+    for (int i = 0; i < commandCount; i++) {
+        // nice takes a priority before the command it runs
+        int offset = strcmp(commands[i][0], "nice") == 0 ? 2 : 0;
+        if (offset == 2 && (commands[i][1] == NULL || commands[i][2] == NULL)) {
+            printf("nice: usage: nice priority command\n");
+            return false;
+        }
+
+        if (findSpawnedCommand(commands[i][offset]) == NULL) {
+            printf("%s: command not found\n", commands[i][offset]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief      Terminates the stages of a pipeline spawned before a later one failed to start, so none is
+ *             left running on a pipe nobody finishes
+ *
+ * @param      job    The job
+ * @param[in]  index  The index of the stage that failed
+ */
+void abandonPipeline(job *job, int index) {
+    for (int i = 0; i < index; i++) {
+        if (job->pids[i] != -1)
+            p_kill(job->pids[i], S_SIGTERM);
+    }
+}
+
 int handleJob(
     char ***commands,
     int commandCount,
@@ -42,40 +117,34 @@ int handleJob(
         return -1;
     }
 
-    char *key = copy[index][offset];
-    if (strcmp(key, "sleep") == 0) {
-        childPid = p_spawn(createSleep, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "zombify") == 0) {
-        childPid = p_spawn(zombify, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "orphanify") == 0) {
-        childPid = p_spawn(orphanify, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "busy") == 0) {
-        childPid = p_spawn(busy, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "ps") == 0) {
-        childPid = p_spawn(ps, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "kill") == 0) {
-        childPid = p_spawn(killer, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "head") == 0) {
-        childPid = p_spawn(head, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "ls") == 0) {
-        childPid = p_spawn(ls, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "touch") == 0) {
-        childPid = p_spawn(touch, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "mv") == 0) {
-        childPid = p_spawn(mv, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "cp") == 0) {
-        childPid = p_spawn(cp, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "rm") == 0) {
-        childPid = p_spawn(rm, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "cat") == 0) {
-        childPid = p_spawn(cat, &copy[index][offset], job->infile, job->outfile);
-    } else if (strcmp(key, "chmod") == 0) {
-        childPid = p_spawn(chmod, &copy[index][offset], job->infile, job->outfile);
-    } else {
-        return 0;
+    // each stage reads the previous stage's pipe and writes the next one, the ends of the
+    // pipeline use the job's redirections
+    if (index < commandCount - 1 && p_pipe(job->pipes[index]) == FAILURE) {
+        printf("Failed to create pipe\n");
+        if (index > 0) {
+            f_close(job->pipes[index - 1][0]);
+        }
+        abandonPipeline(job, index);
+        return -1;
+    }
+    int fd0 = index == 0 ? job->infile : job->pipes[index - 1][0];
+    int fd1 = index == commandCount - 1 ? job->outfile : job->pipes[index][1];
+
+    void (*func)() = findSpawnedCommand(copy[index][offset]);
+    if (func != NULL) {
+        childPid = p_spawn(func, &copy[index][offset], fd0, fd1);
+    }
+
+    // the spawned stage holds its own pipe ends, so the shell lets go of them
+    if (index > 0) {
+        f_close(job->pipes[index - 1][0]);
+    }
+    if (index < commandCount - 1) {
+        f_close(job->pipes[index][1]);
     }
 
     if (childPid == -1) {
+        abandonPipeline(job, index);
         return -1;
     }
 
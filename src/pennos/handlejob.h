@@ -15,6 +15,17 @@
  */
 void terCtrlSighandler(int signum);
 
+/**
+ * @brief      Checks that every command of a job is one that runs as its own process, so a job is either
+ *             started whole or not at all
+ *
+ * @param      commands      the array (NULL-terminated) of parsed commands
+ * @param[in]  commandCount  the number of commands in the parsed input
+ *
+ * @return     true if every command can be spawned, false after reporting the first that cannot
+ */
+bool isSpawnableJob(char ***commands, int commandCount);
+
 /**
  * [handleJob description]
  * @param  commands     the array (NULL-terminated) of parsed commands
@@ -104,8 +104,14 @@ void iter(char *line, bool interactive, int *currentPgId, jobQueue* jobjobQueue)
             int priority = atoi(jobCommands[0][1]);
             pid_t pid = atoi(jobCommands[0][2]);
             p_nice(pid, priority);
-        } else {
-            // otherwise create a new job
+        } else if (strcmp(jobCommands[0][0], "quantum") == 0) {
+            quantum(jobCommands[0]);
+        } else if (strcmp(jobCommands[0][0], "sched") == 0) {
+            sched(jobCommands[0]);
+        } else if (strcmp(jobCommands[0][0], "allocstat") == 0) {
+            allocstat();
+        } else if (isSpawnableJob(jobCommands, commandCount)) {
+            // otherwise create a new job, whose commands are all known so no stage is left running alone
             job *thisJob = newJob(jobCommands, commandCount, infile, outfile);
 
             // check if we succesfully created a new job
@@ -117,17 +123,6 @@ void iter(char *line, bool interactive, int *currentPgId, jobQueue* jobjobQueue)
             for (int i = 0; i < commandCount; i++) {
                 int childpid = handleJob(jobCommands, commandCount, i, thisJob, currentPgId);
 
-                if (childpid == 0) {
-                    if (jobStdin != NULL)
-                        free(jobStdin);
-                    if (jobStdout != NULL)
-                        free(jobStdout);
-                    if (line != NULL)
-                        free(line);
-                    freeJobCommands(jobCommands);
-                    return;
-                }
-
                 // see if the execution succeeded
                 if (childpid == FAILURE) {
                     freeJob(thisJob);
@@ -125,9 +125,11 @@ int handleJobsCommand(jobQueue *q) {
 }
 
 int putJobInForeground(jobQueue *q, job *job, bool interactive) {
-    // send SIGCONT signal to proces group
-    if (p_kill(job->pgId, S_SIGCONT) == -1) {
-        return FAILURE;
+    // send SIGCONT signal to every process in the pipeline still running
+    for (int i = 0; i < job->commandCount; i++) {
+        if (job->pids[i] != -1 && p_kill(job->pids[i], S_SIGCONT) == -1) {
+            return FAILURE;
+        }
     }
 
     job->isRunning = true;
@@ -136,10 +138,16 @@ int putJobInForeground(jobQueue *q, job *job, bool interactive) {
     int waitStatus = 0;
     for (int i = 0; i < job->commandCount; i++) {
         waitStatus = 0;
+        if (job->pids[i] == -1) {
+            continue;
+        }
         do {
-            // wait for all processes in this process group
-            if (p_waitpid(job->pgId, &waitStatus, false) == FAILURE && p_errno != p_ECHILD) {
-                return FAILURE;
+            // wait for each process in the pipeline, the first one holds the terminal
+            if (p_waitpid(job->pids[i], &waitStatus, false) == FAILURE) {
+                if (p_errno != p_ECHILD) {
+                    return FAILURE;
+                }
+                break;
             }
 
         } while (!W_WIFEXITED(waitStatus) && !W_WIFSIGNALED(waitStatus) && !W_WIFSTOPPED(waitStatus));
@@ -147,6 +155,10 @@ int putJobInForeground(jobQueue *q, job *job, bool interactive) {
         if (W_WIFSTOPPED(waitStatus)) {
             break;
         }
+
+        // this process has finished, so a stopped job continued later skips it
+        job->pids[i] = -1;
+        job->processesFinished = job->processesFinished + 1;
     }
 
 
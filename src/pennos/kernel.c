@@ -1,8 +1,14 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <time.h>
 #include <ucontext.h>
 #include <unistd.h>
 
@@ -11,9 +17,21 @@
 #include "node.h"
 #include "PCB.h"
 #include "kernel.h"
+#include "pidmap.h"
+#include "sleepheap.h"
+#include "stackpool.h"
+#include "terminal.h"
 #include "../include/macros.h"
 #include "filedescriptor.h"
 
+#if SMP_CPUS > 1 && FAST_CONTEXT_SWITCH
+#error "FAST_CONTEXT_SWITCH switches on the process stack and needs SMP_CPUS=1"
+#endif
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 void signalhandler(int signum) {
     pcb_t *currProcess = getForegroundProcess();
     write(STDERR_FILENO, "\n", 1);
@@ -32,42 +50,70 @@ void signalhandler(int signum) {
     }
 }
 
+/*
+ * Handler for SIGSEGV, which runs on its own stack. A fault in the guard page
+ * below the running process' stack is a stack overflow and terminates only that
+ * process. Any other fault is left to the default action
+ */
+void overflowHandler(int signum, siginfo_t *info, void *context);
+
 // the signal interrupt context
 ucontext_t signal_context;
 
 // file for logging
 FILE *logFile;
 
-// scheduer
-scheduler *s;
+// the virtual CPUs, each with its own run queues, scheduler and idle process
+cpu_t cpus[SMP_CPUS];
 
-// a pointer to the current process selected by the scheduler
-node *currProcess = NULL;
+#if SMP_CPUS > 1
+// the CPU run by the calling host thread
+__thread cpu_t *localCpu;
+
+// the big kernel lock
+pthread_mutex_t kernelMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 // a pointer to the foreground process node
 node *foregroundProcess = NULL;
 
-// the scheduler context
-ucontext_t schedulerContext;
-
 // main's context
 ucontext_t mainContext;
 
-// the idle process context and parameter
-ucontext_t idleContext;
-bool inIdle = false;
-
 // processTable queue
 queue *processTable = NULL;
 
-// a queue for all the sleep processes
-queue *asleep = NULL;
+// pid index over the process table nodes
+pidMap *pidIndex = NULL;
+
+// a heap for all the sleep processes
+sleepHeap *asleep = NULL;
+
+// the kernel's buffer of terminal input
+terminal console;
 
-bool timeExpired = false;
+// reaped PCBs kept for new processes, linked through their tableNode
+queue freePcbs = { .count = 0, .front = NULL, .back = NULL };
+
+// the number of allocations the kernel has made
+int kernelAllocs = 0;
+
+// kernelAllocs when the last tick was counted, and the allocations made during that tick
+int tickStartAllocs = 0;
+int lastTickAllocs = 0;
 
 // cariable for the total number of ticks that have passed
 int numTicks = 0;
 
+// the monotonic time of the last counted tick, used to catch up after a tickless idle
+struct timespec lastTickTime;
+
+// the length of a clock tick in milliseconds
+int quantumLength = QUANTUM;
+
+// the POSIX timer on CLOCK_MONOTONIC that delivers SIGALRM once per quantum
+timer_t clockTimer;
+
 FILE *getLogfile() {
     return logFile;
 }
@@ -77,15 +123,81 @@ pcb_t *getForegroundProcess() {
 }
 
 pcb_t *getCurrProcess() {
-    return currProcess->pcb;
+    return thisCpu()->currProcess->pcb;
+}
+
+node *findProcess(pid_t pid) {
+    return pidMapFind(pidIndex, pid);
 }
 
 queue *getProcessTable() {
     return processTable;
 }
 
-scheduler *getScheduler() {
-    return s;
+scheduler *getScheduler(int cpu) {
+    return cpus[cpu].s;
+}
+
+cpu_t *thisCpu() {
+#if SMP_CPUS > 1
+    return localCpu;
+#else
+    return &cpus[0];
+#endif
+}
+
+void kernelLock() {
+#if SMP_CPUS > 1
+    cpu_t *cpu = thisCpu();
+    // count the depth first, so a tick arriving meanwhile leaves the lock alone
+    if (cpu->lockDepth++ == 0) {
+        pthread_mutex_lock(&kernelMutex);
+    }
+#endif
+}
+
+void kernelUnlock() {
+#if SMP_CPUS > 1
+    cpu_t *cpu = thisCpu();
+    if (cpu->lockDepth == 1) {
+        pthread_mutex_unlock(&kernelMutex);
+    }
+    cpu->lockDepth--;
+#endif
+}
+
+void kernelLeave(int *entry) {
+    kernelUnlock();
+}
+
+/*
+ * Function for finding the CPU, other than the calling one, that is running a process
+ * @param process, pointer to the process
+ * @return the CPU running the process, or NULL if none is
+ */
+cpu_t *getRemoteCpu(pcb_t *process) {
+    cpu_t *self = thisCpu();
+    for (int i = 0; i < SMP_CPUS; i++) {
+        if (&cpus[i] != self && cpus[i].currProcess != NULL && cpus[i].currProcess->pcb == process) {
+            return &cpus[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function for picking the CPU a new process is queued on, the one with the fewest
+ * READY processes
+ * @return the index of the CPU
+ */
+int getLeastLoadedCpu() {
+    int best = 0;
+    for (int i = 1; i < SMP_CPUS; i++) {
+        if (getSchedulerLoad(cpus[i].s) < getSchedulerLoad(cpus[best].s)) {
+            best = i;
+        }
+    }
+    return best;
 }
 
 int getNumTicks() {
@@ -95,49 +207,111 @@ int getNumTicks() {
 /*
  * Helper function which sets the stack for a context appropriately
  * @param stack, pointer to stack_t struct to contain the new stack
+ * @param size, the stack size in bytes, or 0 for the default
  */
-void setStack(stack_t *stack) {
-    void *sp = malloc(SIGSTKSZ);
-    *stack = (stack_t) { .ss_sp = sp, .ss_size = SIGSTKSZ };
+void setStack(stack_t *stack, size_t size) {
+    if (stackPoolAlloc(stack, size) == -1) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
 }
 
-void makeContext(ucontext_t *ucp,  void (*func)(), char *argv[]) {
-    // get current context
-    getcontext(ucp);
-    sigemptyset(&ucp->uc_sigmask);
-    setStack(&ucp->uc_stack);
-    ucp->uc_link = &schedulerContext;
-
-    // associate it with the input function
-    makecontext(ucp, func, 1, argv);
+/*
+ * Helper function for creating a scheduler or idle context for a CPU, which
+ * restarts that CPU's scheduler if func returns
+ * @param cpu, pointer to the CPU
+ * @param ctx, pointer to the context_t struct which will store the new context
+ * @param func, pointer to the function to be associated with the new context
+ * @param argv, pointer to array of arguments to be passed to func
+ */
+void makeCpuContext(cpu_t *cpu, context_t *ctx, void (*func)(), char *argv[]) {
+    stack_t stack;
+    setStack(&stack, 0);
+    contextMake(ctx, &stack, func, argv, &cpu->schedulerContext);
 }
 
 /*
- * Helper function for adding pid's (in the form of nodes) 
- * to a childrent or zombie list
- * @param pid, the pid of the new child to be added
- * @param queue, the queue where the pid needs to be added (in the form of a node)
+ * Entry point of every process context. Processes run without the kernel lock the
+ * scheduler resumed them with. A returning process goes back to the scheduler of
+ * whichever CPU it finished on, which is why this never returns
+ * @param argv, the arguments passed to the process function
  */
-child *addChild(int pid, child *queue) {
-    // create a new child struct
-    child *c = malloc(sizeof(child));
-    c->prev = NULL;
-    c->pid = pid;
+void processStart(char *argv[]) {
+    pcb_t *process = getCurrProcess();
+    kernelUnlock();
 
-    // insert it to the queue
-    if (queue == NULL) {
-        c->next = NULL;
-    } else {
-        c->next = queue;
-        queue->prev = c;
+    process->entry(argv);
+
+    kernelLock();
+    contextRestart(&thisCpu()->schedulerContext);
+}
+
+void makeProcessContext(pcb_t *process, void (*func)(), char *argv[], size_t stackSize) {
+    setStack(&process->stack, stackSize);
+    process->entry = func;
+
+    // processStart never returns, so there is no context to link to
+    contextMake(&process->context, &process->stack, processStart, argv, NULL);
+}
+
+void *kernelAlloc(size_t size) {
+    kernelAllocs++;
+    return malloc(size);
+}
+
+int getKernelAllocs() {
+    return kernelAllocs;
+}
+
+int getTickAllocs() {
+    return lastTickAllocs;
+}
+
+/*
+ * Function for getting the PCB of a new process, reusing a reaped one when there is one
+ * @return a pointer to the PCB, or NULL if one could not be allocated
+ */
+pcb_t *takePcb() {
+    node *reaped = queuePop(&freePcbs);
+    if (reaped == NULL) {
+        return kernelAlloc(sizeof(pcb_t));
     }
 
-    return c;
+    pcb_t *process = reaped->pcb;
+    free(process->name);
+    return process;
+}
+
+/*
+ * Function for giving the stack and PCB of a reaped process back for reuse
+ * @param process, pointer to the process
+ */
+void recycleProcess(pcb_t *process) {
+    stackPoolRelease(&process->stack);
+    queuePush(&freePcbs, &process->tableNode);
+}
+
+/*
+ * Function for setting up the list links of a new process, none of which are on a list yet
+ * @param process, pointer to the process, whose pid is set
+ */
+void initProcessLinks(pcb_t *process) {
+    process->children = (queue) { .count = 0, .front = NULL, .back = NULL };
+    process->childEvents = (queue) { .count = 0, .front = NULL, .back = NULL };
+    process->childWait = (queue) { .count = 0, .front = NULL, .back = NULL };
+    nodeInit(&process->tableNode, process->pid, process);
+    nodeInit(&process->runNode, process->pid, process);
+    nodeInit(&process->siblingNode, process->pid, process);
+    nodeInit(&process->eventNode, process->pid, process);
+    nodeInit(&process->waitNode, process->pid, process);
+    process->runnable = false;
+    process->eventPosted = false;
+    process->waitingOn = NULL;
 }
 
 pcb_t *k_process_create(pcb_t *parent) {
     // create the new process
-    pcb_t *process = malloc(sizeof(pcb_t));
+    pcb_t *process = takePcb();
 
 
     if (process == NULL) {
@@ -149,8 +323,8 @@ pcb_t *k_process_create(pcb_t *parent) {
     process->ppid = parent->pid;
     process->pgid = parent->pgid;
     process->context = parent->context;
+    process->stack = (stack_t) { .ss_sp = NULL, .ss_size = 0 };
     process->status = READY;
-    process->prevStatus = READY;
     process->priority_level = 0;
     process->waitedOn = false;
     // generate new pid
@@ -160,138 +334,128 @@ pcb_t *k_process_create(pcb_t *parent) {
         process->pid = processTable->back->pid + 1;
     }
     process->ticksLeft = -1;
-    process->child_pids = NULL;
-    process->zombies = NULL;
-    process->stdin = STDIN_FILENO;
-    process->stdout = STDOUT_FILENO;
-
-    // add the current process to the children list of the parent
-    parent->child_pids = addChild(process->pid, parent->child_pids);
-
-    // create a node for the new process and add it to the process 
-    // table and scheduler queue
-    node *n1 = newNode(process->pid, process);
-    queuePush(processTable, n1);
-    node *n2 = newNode(process->pid, process);
-    addToScheduler(n2, s);
+    process->wakeTick = 0;
+    process->sleepIndex = -1;
+    process->name = NULL;
+    // the spawner fills in the descriptors the process starts with
+    for (int fd = 0; fd < FD_TABLE_SIZE; fd++) {
+        process->fds[fd] = NULL;
+    }
+    process->cpu = getLeastLoadedCpu();
+    process->lockDepth = 1;
+    process->entry = NULL;
+    process->pass = 0;
+    initProcessLinks(process);
+
+    // add the current process to the front of the children list of the parent
+    queueInsertAfter(&parent->children, NULL, &process->siblingNode);
+
+    // add the new process to the process table and scheduler queue
+    queuePush(processTable, &process->tableNode);
+    pidMapInsert(pidIndex, &process->tableNode);
+    addToScheduler(process, cpus[process->cpu].s);
     return process;
 }
 
 void k_process_cleanup(pcb_t *process) {
     // remove the process from the scheduler queue and process table
-    node *toRemove = queueSearch(processTable, newNode(process->pid, NULL));
-    queueRemoveNode(processTable, toRemove);
-    if (toRemove == NULL) {
+    node *toRemove = findProcess(process->pid);
+    if (toRemove != &process->tableNode) {
         p_errno = -1;
         return;
     }
-    removeFromScheduler(toRemove, s);
-    node *parent = queueSearch(processTable, newNode(process->ppid, NULL));
+    queueRemoveNode(processTable, toRemove);
+    pidMapRemove(pidIndex, toRemove->pid);
+    fdCloseAll(process);
+    sleepHeapRemove(asleep, process);
+    removeFromScheduler(toRemove->pcb, cpus[process->cpu].s);
+
+    // remove process from parent's children and child events
+    node *parent = findProcess(process->ppid);
     if (parent != NULL) {
-        child *currChild = parent->pcb->child_pids;
-        // remove process from parent's children list
-        while (currChild != NULL) {
-            if (currChild->pid == toRemove->pid) {
-                if (currChild->prev != NULL) {
-                    currChild->prev->next = currChild->next;
-                } else {
-                    parent->pcb->child_pids = currChild->next;
-                }
+        queueRemoveNode(&parent->pcb->children, &process->siblingNode);
+        withdrawChildEvent(process);
+    }
 
-                if (currChild->next != NULL) {
-                    currChild->next->prev = currChild->prev;
-                }
-                break;
-            }
-            currChild = currChild->next;
-        }
+    // the terminal goes back to the parent if the process holding it is reaped
+    if (foregroundProcess == toRemove) {
+        foregroundProcess = parent != NULL ? parent : findProcess(1);
+    }
 
-        // remove process from parent's zombie list
-        child *currZombie = parent->pcb->zombies;
-        while (currZombie != NULL) {
-            if (currZombie->pid == toRemove->pid) {
-                if (currZombie->prev != NULL) {
-                    currZombie->prev->next = currZombie->next;
-                } else {
-                    parent->pcb->zombies = currZombie->next;
-                }
+    // the process will never run again, so its stack and PCB can be reused. Another
+    // CPU may still be running it until its next tick, and releases them after that
+    cpu_t *remote = getRemoteCpu(process);
+    if (remote != NULL) {
+        remote->releaseProcess = true;
+    } else {
+        recycleProcess(process);
+    }
+}
 
-                if (currZombie->next != NULL) {
-                    currZombie->next->prev = currZombie->prev;
-                }
-                break;
-            }
-            currZombie = currZombie->next;
-        }
+
+void clearZombiesAndChildren(pcb_t *process) {
+    // clean up children of current process, zombies included. Cleaning one up
+    // unlinks it, so the next link is read first. An orphan's own children go
+    // before it, while its PCB is still live and its pid still finds it
+    node *childNode = process->children.front;
+    while (childNode != NULL) {
+        node *next = childNode->next;
+        pcb_t *orphan = childNode->pcb;
+        fprintf(logFile, "[%d] ORPHAN %d %d %s\n", numTicks, orphan->pid, orphan->priority_level, orphan->name);
+        clearZombiesAndChildren(orphan);
+        k_process_cleanup(orphan);
+        childNode = next;
     }
 }
 
+void waitOn(queue *waitQueue) {
+    pcb_t *process = getCurrProcess();
+    if (process->status != BLOCKED) {
+        fprintf(logFile, "[%d] BLOCKED %d %d %s\n", numTicks, process->pid, process->priority_level, process->name);
+    }
+    setProcessStatus(process, BLOCKED);
+    queuePush(waitQueue, &process->waitNode);
+    process->waitingOn = waitQueue;
+    switchContext(0);
+}
 
-pid_t traverseChild(pcb_t *process, int *wstatus) {
-    
-    //check for zombies
-    child *zombieChild = process->zombies;
-    if (zombieChild != NULL) {
-        // get rid of zombie
-        node *childNode = queueSearch(processTable, newNode(zombieChild->pid, NULL));
-        childNode->pcb->prevStatus = childNode->pcb->status;
-        *wstatus = childNode->pcb->status;
-        k_process_cleanup(childNode->pcb);
-        return zombieChild->pid;
-    }
-
-    // iterate through children
-    child *child = process->child_pids;
-    while (child != NULL) {
-        node *childNode = queueSearch(processTable, newNode(child->pid, NULL));
-        
-        // check if there was a status change
-        if (childNode->pcb->prevStatus != -1 && (childNode->pcb->prevStatus != childNode->pcb->status)) {
-            childNode->pcb->prevStatus = childNode->pcb->status;
-            *wstatus = childNode->pcb->status;
-            
-            // unblock parent only if in foreground
-            pcb_t *foregroundProcess = getForegroundProcess();
-            if (childNode->pid == foregroundProcess->pid) {
-                unblockParent(childNode->pcb->ppid);
-            }
-            return childNode->pid;
-        }
+void wakeUp(queue *waitQueue) {
+    while (waitQueue->front != NULL) {
+        pcb_t *process = waitQueue->front->pcb;
+        fprintf(logFile, "[%d] UNBLOCKED %d %d %s\n", numTicks, process->pid, process->priority_level, process->name);
+        setProcessStatus(process, READY);
+    }
+}
 
-        // recursively check grandchildren
-        pid_t res = traverseChild(childNode->pcb, wstatus);
-        if (res != 0) {
-            return res;
-        }
-        child = child->next;
+/*
+ * Function for posting a child's stop or exit to its parent, and waking the parent
+ * if it is waiting. A child has at most one event posted, holding its latest status
+ * @param process, pointer to the child
+ */
+void postChildEvent(pcb_t *process) {
+    node *parent = findProcess(process->ppid);
+    if (parent == NULL || parent->pcb == process) {
+        return;
     }
-    return 0;
+
+    process->eventStatus = process->status;
+    if (!process->eventPosted) {
+        queuePush(&parent->pcb->childEvents, &process->eventNode);
+        process->eventPosted = true;
+    }
+    wakeUp(&parent->pcb->childWait);
 }
 
-void clearZombiesAndChildren(pcb_t *process) {
-    //clean up zombies of process
-    child *zombieChild = process->zombies;
-    while (zombieChild != NULL) {
-        node *nodeToRemove = queueSearch(processTable, newNode(zombieChild->pid, NULL));
-        if (nodeToRemove != NULL) {
-            fprintf(logFile, "[%d] ORPHAN %d %d %s\n", numTicks, nodeToRemove->pcb->pid, nodeToRemove->pcb->priority_level, nodeToRemove->pcb->name);
-            k_process_cleanup(nodeToRemove->pcb);
-            clearZombiesAndChildren(nodeToRemove->pcb);
-        }
-        zombieChild = zombieChild->next;
+void withdrawChildEvent(pcb_t *process) {
+    if (!process->eventPosted) {
+        return;
     }
 
-    //clean up children of current process
-    child *children = process->child_pids;
-    while (children != NULL) {
-        node *nodeToRemove = queueSearch(processTable, newNode(children->pid, NULL));
-        if (nodeToRemove != NULL) {
-            fprintf(logFile, "[%d] ORPHAN %d %d %s\n", numTicks, nodeToRemove->pcb->pid, nodeToRemove->pcb->priority_level, nodeToRemove->pcb->name);
-            k_process_cleanup(nodeToRemove->pcb);
-            clearZombiesAndChildren(nodeToRemove->pcb);
-        }
-        children = children->next;
+    node *parent = findProcess(process->ppid);
+    if (parent != NULL) {
+        queueRemoveNode(&parent->pcb->childEvents, &process->eventNode);
     }
+    process->eventPosted = false;
 }
 
 /*
@@ -300,7 +464,7 @@ void clearZombiesAndChildren(pcb_t *process) {
  * @param ppid, the parent pid
  */
 void unblockParent(pid_t ppid) {
-    node *parent = queueSearch(processTable, newNode(ppid, NULL));
+    node *parent = findProcess(ppid);
 
     if (parent == NULL) {
         p_errno = -1;
@@ -309,19 +473,44 @@ void unblockParent(pid_t ppid) {
 
     if (parent->pcb->status == BLOCKED) {
         fprintf(logFile, "[%d] UNBLOCKED %d %d %s\n", numTicks, parent->pcb->pid, parent->pcb->priority_level, parent->pcb->name);
-        parent->pcb->status = READY;
+        setProcessStatus(parent->pcb, READY);
+    }
+
+    // the terminal goes back to the parent, which the child's event may have woken already
+    if (foregroundProcess != parent) {
         setForeground(ppid);
     }
 }
 
-void dealWithUnwaitedProcess(pcb_t *process) {
-    // remove from scheduler queue
-    removeFromScheduler(newNode(process->pid, process), s);
+void setProcessStatus(pcb_t *process, int status) {
+    // run queues hold only READY processes, so move the process in or out
+    // of the scheduler when it crosses that boundary
+    if (status == READY) {
+        addToScheduler(process, cpus[process->cpu].s);
+    } else {
+        removeFromScheduler(process, cpus[process->cpu].s);
+    }
 
-    // add child to parent's zombie queue
-    node *parent = queueSearch(processTable, newNode(process->ppid, NULL));
-    parent->pcb->zombies = addChild(process->pid, parent->pcb->zombies);
+    // a process only waits on a queue while it is BLOCKED
+    if (status != BLOCKED && process->waitingOn != NULL) {
+        queueRemoveNode(process->waitingOn, &process->waitNode);
+        process->waitingOn = NULL;
+    }
+    process->status = status;
 
+    // stops and exits are reported to the parent, and a stop no longer is once continued
+    if (status == STOPPED || status == SIGNALED || status == EXITED) {
+        postChildEvent(process);
+    } else if (process->eventPosted && process->eventStatus == STOPPED) {
+        withdrawChildEvent(process);
+    }
+}
+
+void dealWithUnwaitedProcess(pcb_t *process) {
+    // a pipe sees its end closed as soon as the process ends, rather than once it is reaped
+    fdCloseAll(process);
+
+    // the process stays a zombie on its parent's children until its exit event is waited on
     if (!process->waitedOn) {
         fprintf(logFile, "[%d] ZOMBIE %d %d %s\n", numTicks, process->pid, process->priority_level, process->name);
     }
@@ -333,7 +522,12 @@ void dealWithUnwaitedProcess(pcb_t *process) {
 void k_process_kill(pcb_t *process, int signal) {
     if (signal == S_SIGSTOP) {
         // update process status
-        process->status = STOPPED;
+        setProcessStatus(process, STOPPED);
+        // a stopped sleeper keeps the ticks it has left until it is continued
+        if (process->sleepIndex != -1) {
+            process->ticksLeft = process->wakeTick > numTicks ? process->wakeTick - numTicks : 0;
+            sleepHeapRemove(asleep, process);
+        }
         if (process->pid == foregroundProcess->pid) {
             unblockParent(process->ppid);
         }
@@ -343,16 +537,20 @@ void k_process_kill(pcb_t *process, int signal) {
         // update process status
         if (process->status == STOPPED) {
             if (strcmp(process->name, "sleep") == 0) {
-                process->status = BLOCKED;
+                setProcessStatus(process, BLOCKED);
+                if (process->ticksLeft >= 0) {
+                    addToAsleep(process);
+                }
             } else {
-                process->status = READY;
+                setProcessStatus(process, READY);
             }
             fprintf(logFile, "[%d] CONTINUED %d %d %s\n", numTicks, process->pid, process->priority_level, process->name);
         }
         switchContext(0);
     } else {
         // update status
-        process->status = SIGNALED;
+        setProcessStatus(process, SIGNALED);
+        sleepHeapRemove(asleep, process);
         if (process->pid == foregroundProcess->pid) {
             unblockParent(process->ppid);
         }
@@ -363,35 +561,115 @@ void k_process_kill(pcb_t *process, int signal) {
 }
 
 /*
- * Function for reducing the number of ticks by one for all 
- * the asleep processes
+ * Function for finishing the sleep processes whose wake tick has passed. Only
+ * expired sleepers are visited
  */
-void decrementTicks() {
-    node *head = asleep->front;
-    while (head != NULL) {
-        // if there are more than one ticks left decrease them 
-        // by one if the process is still running
-        if (head->pcb->ticksLeft > 0) {
-            if (head->pcb->status != STOPPED) {
-                head->pcb->ticksLeft -= 1;
-            }
-        } else {
-            // deal with finished sleep childs only once
-            if (head->pcb->ticksLeft == 0 && head->pcb->status != EXITED) {
-                if (head->pcb->status != SIGNALED) {
-                    head->pcb->status = EXITED;
-                }
-                fprintf(logFile, "[%d] EXITED %d %d %s\n", numTicks, head->pcb->pid, head->pcb->priority_level, head->pcb->name);
-                node *parent = queueSearch(processTable, newNode(head->pcb->ppid, NULL));
-                dealWithUnwaitedProcess(head->pcb);
-                queueRemoveNode(asleep, head);
-                if (head->pid == foregroundProcess ->pid) {
-                    unblockParent(parent->pid);
-                }
-            }
+void wakeSleepers() {
+    pcb_t *process = sleepHeapPeek(asleep);
+    while (process != NULL && process->wakeTick <= numTicks) {
+        sleepHeapRemove(asleep, process);
+        process->ticksLeft = 0;
+        setProcessStatus(process, EXITED);
+        fprintf(logFile, "[%d] EXITED %d %d %s\n", numTicks, process->pid, process->priority_level, process->name);
+        dealWithUnwaitedProcess(process);
+        if (process->pid == foregroundProcess->pid) {
+            unblockParent(process->ppid);
         }
-        head = head->next;
+        process = sleepHeapPeek(asleep);
+    }
+}
+
+/*
+ * Function for moving input the host terminal has ready into the kernel's buffer, and
+ * unblocking the processes waiting for it. The host is only polled while someone waits,
+ * a reader checks the host itself before it blocks
+ */
+void pollTerminal() {
+    if (console.readers.count == 0) {
+        return;
+    }
+
+    terminalFill(&console, STDIN_FILENO);
+    if (!terminalHasInput(&console)) {
+        return;
+    }
+
+    // every reader is unblocked, those that find the input taken wait again
+    wakeUp(&console.readers);
+}
+
+int terminalRead(uint8_t *buf, int n) {
+    terminalFill(&console, STDIN_FILENO);
+    while (!terminalHasInput(&console)) {
+        // block until the scheduler sees input arrive
+        waitOn(&console.readers);
     }
+
+    return terminalTake(&console, buf, n);
+}
+
+/*
+ * Helper function for getting the nanoseconds between two monotonic times
+ */
+long long elapsedNanos(struct timespec *from, struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1000000000LL + (to->tv_nsec - from->tv_nsec);
+}
+
+/*
+ * Helper function for converting nanoseconds to a timespec
+ */
+struct timespec nanosToTimespec(long long nanos) {
+    return (struct timespec) { .tv_sec = nanos / 1000000000LL, .tv_nsec = nanos % 1000000000LL };
+}
+
+/*
+ * Helper function for arming a tick timer, a zero first delay disarms it
+ * @param timer, the clock timer or a CPU's preemption timer
+ * @param first, the nanoseconds until the first tick
+ * @param interval, the nanoseconds between later ticks, 0 for a one-shot timer
+ */
+void programTimer(timer_t timer, long long first, long long interval) {
+    struct itimerspec it;
+
+    it.it_value = nanosToTimespec(first);
+    it.it_interval = nanosToTimespec(interval);
+
+    timer_settime(timer, 0, &it, NULL);
+}
+
+/*
+ * Function for stopping the periodic tick when entering idle. A one-shot timer is
+ * armed for the earliest sleeper's wake tick, or no timer at all if nothing sleeps
+ */
+void enterTicklessIdle() {
+    pcb_t *next = sleepHeapPeek(asleep);
+    if (next == NULL) {
+        programTimer(clockTimer, 0, 0);
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ticks = next->wakeTick > numTicks ? next->wakeTick - numTicks : 1;
+    long long delay = ticks * quantumLength * 1000000LL - elapsedNanos(&lastTickTime, &now);
+    programTimer(clockTimer, delay > 0 ? delay : 1, 0);
+}
+
+/*
+ * Function for catching numTicks up with the monotonic clock when leaving a
+ * tickless idle, and restarting the periodic tick in phase with the last tick
+ */
+void leaveTicklessIdle() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long period = quantumLength * 1000000LL;
+    long long elapsed = elapsedNanos(&lastTickTime, &now);
+    long long ticks = elapsed / period;
+
+    numTicks += ticks;
+    lastTickTime = nanosToTimespec(lastTickTime.tv_sec * 1000000000LL + lastTickTime.tv_nsec + ticks * period);
+
+    programTimer(clockTimer, period - (elapsed - ticks * period), period);
 }
 
 /*
@@ -400,15 +678,124 @@ void decrementTicks() {
 void idle() {
     sigset_t mask;
     sigemptyset(&mask);
-    sigsuspend(&mask);
+
+    if (console.readers.count == 0) {
+        sigsuspend(&mask);
+        return;
+    }
+
+    // wait for the next tick or for terminal input, whichever comes first. A tick
+    // restarts the scheduler itself, so getting past ppoll means input arrived
+    struct pollfd host = { .fd = STDIN_FILENO, .events = POLLIN };
+    if (ppoll(&host, 1, NULL, &mask) > 0) {
+        sigset_t alarm;
+        sigemptyset(&alarm);
+        sigaddset(&alarm, SIGALRM);
+        sigprocmask(SIG_BLOCK, &alarm, NULL);
+#if TICKLESS_IDLE
+        leaveTicklessIdle();
+#endif
+        cpu_t *cpu = thisCpu();
+        cpu->timeExpired = true;
+        contextRestart(&cpu->schedulerContext);
+    }
+}
+
+#if SMP_CPUS > 1
+/*
+ * Function for an idle CPU to take a READY process from another CPU's run queues.
+ * The process is moved to the thief's run queues
+ * @param thief, pointer to the idle CPU
+ * @return the stolen process' node in the thief's run queue, or NULL if there is none
+ */
+node *stealProcess(cpu_t *thief) {
+    for (int i = 1; i < SMP_CPUS; i++) {
+        cpu_t *victim = &cpus[(thief->id + i) % SMP_CPUS];
+        pcb_t *running = victim->currProcess != NULL ? victim->currProcess->pcb : NULL;
+        pcb_t *process = stealFromScheduler(victim->s, running);
+        if (process != NULL) {
+            process->cpu = thief->id;
+            addToScheduler(process, thief->s);
+            fprintf(logFile, "[%d] STOLEN %d %d %s\n", numTicks, process->pid, process->priority_level, process->name);
+            return getNextProcess(thief->s);
+        }
+    }
+    return NULL;
+}
+#endif
+
+/*
+ * Function for taking the next process from this CPU's scheduler and logging it.
+ * An idle CPU steals work from the others
+ * @return the next process, or NULL if no process is ready
+ */
+node *pickNextProcess() {
+    cpu_t *cpu = thisCpu();
+    node *next = getNextProcess(cpu->s);
+#if SMP_CPUS > 1
+    if (next == NULL) {
+        next = stealProcess(cpu);
+    }
+#endif
+    if (next != NULL) {
+        fprintf(logFile, "[%d] SCHEDULE %d %d %s\n", numTicks, next->pid, next->pcb->priority_level, next->pcb->name);
+    }
+    return next;
+}
+
+/*
+ * Function for charging the process a tick switched out for the quantum it ran,
+ * under the scheduling policy of its CPU
+ * @param cpu, pointer to the CPU
+ */
+void chargeQuantum(cpu_t *cpu) {
+    if (cpu->preempted) {
+        cpu->preempted = false;
+        schedulerTick(cpu->currProcess->pcb, cpu->s);
+    }
+}
+
+/*
+ * Function for running a process on this CPU, without saving the running context
+ * @param process, the node of the process
+ */
+void resumeProcess(node *process) {
+    cpu_t *cpu = thisCpu();
+    cpu->currProcess = process;
+    process->pcb->cpu = cpu->id;
+#if SMP_CPUS > 1
+    // the process carries on with the kernel lock at the depth it left it at
+    cpu->lockDepth = process->pcb->lockDepth;
+#endif
+    contextResume(&(process->pcb->context));
 }
 
 void schedule() {
-    decrementTicks();
+    cpu_t *cpu = thisCpu();
+#if SMP_CPUS > 1
+    // the scheduler holds the kernel lock exactly once, whatever depth the last
+    // process left it at. Only a return from idle arrives without it
+    if (cpu->lockDepth == 0) {
+        kernelLock();
+    }
+    cpu->lockDepth = 1;
+#endif
+
+    // a process cleaned up by another CPU while running here is switched out now
+    if (cpu->releaseProcess) {
+        recycleProcess(cpu->currProcess->pcb);
+        cpu->releaseProcess = false;
+    }
+
+    chargeQuantum(cpu);
+
+    wakeSleepers();
+    pollTerminal();
     // handle processes that terminate on their own
-    if (!timeExpired && currProcess->pcb->ticksLeft != -2) {
+    if (!cpu->timeExpired && cpu->currProcess->pcb->ticksLeft != -2) {
+        node *currProcess = cpu->currProcess;
         if (currProcess->pcb->ticksLeft <= 0) {
-            currProcess->pcb->status = EXITED;
+            setProcessStatus(currProcess->pcb, EXITED);
             fprintf(logFile, "[%d] EXITED %d %d %s\n", numTicks, currProcess->pcb->pid, currProcess->pcb->priority_level, currProcess->pcb->name);
             dealWithUnwaitedProcess(currProcess->pcb);
             if (currProcess->pid == foregroundProcess->pid) {
@@ -419,42 +806,203 @@ void schedule() {
     }
 
     // get the next process
-    currProcess = getNextProcess(s);
+    cpu->currProcess = pickNextProcess();
 
     // if no processes are available run idle process
-    if (currProcess == NULL) {
-        inIdle = true;
-        setcontext(&idleContext);
+    if (cpu->currProcess == NULL) {
+        cpu->inIdle = true;
+#if TICKLESS_IDLE
+        enterTicklessIdle();
+#endif
+        // idle without the kernel lock, the tick that ends idle takes it back
+        kernelUnlock();
+        contextRestart(&cpu->idleContext);
     }
 
-    inIdle = false;
-    timeExpired = false;
-    // log schedule event
-    pid_t pid = currProcess->pid;
-    int queue = currProcess->pcb->priority_level;
+    cpu->inIdle = false;
+    cpu->timeExpired = false;
 
-    fprintf(logFile, "[%d] SCHEDULE %d %d %s\n", numTicks, pid, queue, currProcess->pcb->name);
+    // switch context to the next process
+    resumeProcess(cpu->currProcess);
+}
 
-    // update foreground process
-    timeExpired = false;
+#if FAST_CONTEXT_SWITCH
+/*
+ * Function for switching straight from the running process to the next one,
+ * without a trip through the scheduler context. Nothing is switched when the
+ * running process is picked again. Returns when the calling process is resumed
+ * @param signum, SIGALRM for a tick, 0 for a voluntary switch
+ */
+void directSwitch(int signum) {
+#if CONTEXT_ASM
+    // the register-only switch keeps the signal mask, so block signals around a
+    // voluntary switch. A tick's handler runs with them blocked already
+    sigset_t all, old;
+    if (signum != SIGALRM) {
+        sigfillset(&all);
+        sigprocmask(SIG_BLOCK, &all, &old);
+    }
+#endif
+
+    cpu_t *cpu = thisCpu();
+    node *prev = cpu->currProcess;
+    chargeQuantum(cpu);
+    wakeSleepers();
+    pollTerminal();
+    cpu->currProcess = pickNextProcess();
+    cpu->timeExpired = false;
+
+    if (cpu->currProcess == NULL) {
+        cpu->inIdle = true;
+#if TICKLESS_IDLE
+        enterTicklessIdle();
+#endif
+        contextReset(&cpu->idleContext);
+        contextSwitch(&(prev->pcb->context), &cpu->idleContext);
+    } else if (cpu->currProcess->pcb != prev->pcb) {
+        contextSwitch(&(prev->pcb->context), &(cpu->currProcess->pcb->context));
+    }
 
-    // switch context to the next process
-    setcontext(&(currProcess->pcb->context));
+#if CONTEXT_ASM
+    if (signum != SIGALRM) {
+        sigprocmask(SIG_SETMASK, &old, NULL);
+    }
+#endif
 }
+#endif
 
 
+/*
+ * Function for counting a clock tick on the CPU keeping the clock, including the
+ * expirations that were merged into this signal because it was delivered late
+ * @param cpu, pointer to the CPU the tick arrived on
+ */
+void countTick(cpu_t *cpu) {
+    if (cpu->id == 0) {
+        int overrun = timer_getoverrun(clockTimer);
+        numTicks += 1 + (overrun > 0 ? overrun : 0);
+        clock_gettime(CLOCK_MONOTONIC, &lastTickTime);
+        lastTickAllocs = kernelAllocs - tickStartAllocs;
+        tickStartAllocs = kernelAllocs;
+    }
+}
+
 void switchContext(int signum) {
-    timeExpired = true;
+    cpu_t *cpu = thisCpu();
+    cpu->timeExpired = true;
+
+#if TICKLESS_IDLE
+    // the periodic tick is stopped while idle, so count ticks from the clock
+    if (cpu->inIdle) {
+        leaveTicklessIdle();
+        contextRestart(&cpu->schedulerContext);
+    }
+#endif
 
     // increment tick count only when signum = SIGALRM
     if (signum == SIGALRM) {
-        numTicks += 1;
+        countTick(cpu);
     }
-    if (inIdle) {
-        setcontext(&schedulerContext);
+
+#if SMP_CPUS > 1
+    // a CPU is not preempted while it holds the kernel lock, the next tick retries
+    if (signum == SIGALRM) {
+        if (cpu->lockDepth > 0) {
+            return;
+        }
+        kernelLock();
+    }
+#endif
+
+    if (cpu->inIdle) {
+        contextRestart(&cpu->schedulerContext);
     } else {
-        swapcontext(&(currProcess->pcb->context), &schedulerContext);
+        cpu->preempted = signum == SIGALRM;
+#if FAST_CONTEXT_SWITCH
+        directSwitch(signum);
+#else
+        cpu->currProcess->pcb->lockDepth = cpu->lockDepth;
+        contextSwitch(&(cpu->currProcess->pcb->context), &cpu->schedulerContext);
+#endif
     }
+
+#if SMP_CPUS > 1
+    // resumed, possibly on another CPU, so leave the lock taken for the tick
+    if (signum == SIGALRM) {
+        kernelUnlock();
+    }
+#endif
+}
+
+#if SMP_CPUS > 1
+// the bounds of PennOS' own code, set by the linker
+extern char __executable_start[];
+extern char etext[];
+
+/*
+ * Handler for SIGALRM with more than one CPU. With several host threads, libc takes
+ * real locks in malloc and stdio, and a process switched out while holding one would
+ * stall every CPU that needs it. So a process is only preempted while it runs PennOS
+ * code, and a tick that interrupts it inside libc is only counted
+ */
+void tickHandler(int signum, siginfo_t *info, void *context) {
+    cpu_t *cpu = thisCpu();
+#if defined(__x86_64__)
+    uintptr_t pc = ((ucontext_t *) context)->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+    uintptr_t pc = ((ucontext_t *) context)->uc_mcontext.pc;
+#else
+    uintptr_t pc = (uintptr_t) __executable_start;
+#endif
+
+    if (!cpu->inIdle && (pc < (uintptr_t) __executable_start || pc >= (uintptr_t) etext)) {
+        countTick(cpu);
+        return;
+    }
+    switchContext(signum);
+}
+#endif
+
+void overflowHandler(int signum, siginfo_t *info, void *context) {
+    cpu_t *cpu = thisCpu();
+    if (cpu->currProcess == NULL || cpu->inIdle || !stackPoolIsGuard(&cpu->currProcess->pcb->stack, info->si_addr)) {
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+
+    KERNEL_ENTER;
+    node *currProcess = cpu->currProcess;
+    fprintf(logFile, "[%d] OVERFLOW %d %d %s\n", numTicks, currProcess->pid, currProcess->pcb->priority_level, currProcess->pcb->name);
+    write(STDERR_FILENO, "Stack overflow\n", 15);
+    k_process_kill(currProcess->pcb, S_SIGTERM);
+}
+
+/*
+ * Gives the calling host thread an alternate stack to run the SIGSEGV handler on
+ */
+void setSignalStack(void) {
+    stack_t altStack;
+    if (stackPoolAlloc(&altStack, 0) == -1) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    sigaltstack(&altStack, NULL);
+}
+
+/*
+ * Sets the SIGSEGV handler that catches stack overflows, on an alternate stack
+ * since the faulting stack has no room left
+ */
+void setOverflowHandler(void) {
+    setSignalStack();
+
+    struct sigaction act;
+
+    act.sa_sigaction = overflowHandler;
+    act.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigfillset(&act.sa_mask);
+
+    sigaction(SIGSEGV, &act, NULL);
 }
 
 /*
@@ -463,27 +1011,154 @@ void switchContext(int signum) {
 void setAlarmHandler(void) {
     struct sigaction act;
 
+#if SMP_CPUS > 1
+    act.sa_sigaction = tickHandler;
+    act.sa_flags = SA_RESTART | SA_SIGINFO;
+#else
     act.sa_handler = switchContext;
     act.sa_flags = SA_RESTART;
+#endif
     sigfillset(&act.sa_mask);
 
     sigaction(SIGALRM, &act, NULL);
 }
 
 /*
- * Creates the itimerval object which will generate the clock ticks
+ * Helper function for creating a timer delivering SIGALRM every quantum. With more
+ * than one CPU, it is delivered to the calling host thread only
+ * @param timer, pointer to the timer_t to create
+ */
+void createTickTimer(timer_t *timer) {
+    struct sigevent event = { .sigev_notify = SIGEV_SIGNAL, .sigev_signo = SIGALRM };
+#if SMP_CPUS > 1
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_notify_thread_id = syscall(SYS_gettid);
+#endif
+
+    if (timer_create(CLOCK_MONOTONIC, &event, timer) == -1) {
+        perror("timer_create");
+        exit(EXIT_FAILURE);
+    }
+
+    programTimer(*timer, quantumLength * 1000000LL, quantumLength * 1000000LL);
+}
+
+/*
+ * Creates the POSIX timer which will generate the clock ticks
  */
 void setTimer(void) {
-    struct itimerval it;
+    clock_gettime(CLOCK_MONOTONIC, &lastTickTime);
+    createTickTimer(&clockTimer);
+}
+
+int getQuantum() {
+    return quantumLength;
+}
 
-    it.it_interval = (struct timeval) { .tv_usec = QUANTUM * 1000};
-    it.it_value = it.it_interval;
+int setQuantum(int ms) {
+    if (ms < MIN_QUANTUM || ms > MAX_QUANTUM) {
+        return FAILURE;
+    }
+
+    KERNEL_ENTER;
+
+    // keep the clock from ticking while deadlines are converted
+    sigset_t mask, old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &old);
+
+    // sleep deadlines are counted in ticks, so rescale what is left of them to the
+    // new tick length, rounding up. The conversion keeps the sleep heap ordered
+    node *n = processTable->front;
+    while (n != NULL) {
+        pcb_t *process = n->pcb;
+        if (process->sleepIndex != -1) {
+            long long left = process->wakeTick - numTicks;
+            process->wakeTick = numTicks + (left * quantumLength + ms - 1) / ms;
+        }
+        if (process->ticksLeft > 0) {
+            process->ticksLeft = ((long long) process->ticksLeft * quantumLength + ms - 1) / ms;
+        }
+        n = n->next;
+    }
+
+    fprintf(logFile, "[%d] QUANTUM %d %d\n", numTicks, quantumLength, ms);
+    quantumLength = ms;
+    clock_gettime(CLOCK_MONOTONIC, &lastTickTime);
+    programTimer(clockTimer, quantumLength * 1000000LL, quantumLength * 1000000LL);
+    for (int i = 1; i < SMP_CPUS; i++) {
+        programTimer(cpus[i].timer, quantumLength * 1000000LL, quantumLength * 1000000LL);
+    }
+
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return SUCCESS;
+}
+
+char *getSchedulingPolicy() {
+    return cpus[0].s->policy->name;
+}
+
+int setSchedulingPolicy(char *name) {
+    schedulerPolicy *policy = findSchedulerPolicy(name);
+    if (policy == NULL) {
+        return FAILURE;
+    }
+
+    KERNEL_ENTER;
+
+    // keep the clock from preempting while the run queues are rebuilt
+    sigset_t mask, old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &old);
 
-    setitimer(ITIMER_REAL, &it, NULL);
+    fprintf(logFile, "[%d] POLICY %s %s\n", numTicks, getSchedulingPolicy(), policy->name);
+    for (int i = 0; i < SMP_CPUS; i++) {
+        setSchedulerPolicy(cpus[i].s, policy);
+    }
+
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return SUCCESS;
 }
 
-void addToAsleep(node *n) {
-    queuePush(asleep, n);
+void addToAsleep(pcb_t *process) {
+    process->wakeTick = numTicks + process->ticksLeft;
+    sleepHeapPush(asleep, process);
+}
+
+#if SMP_CPUS > 1
+/*
+ * Entry point of the host thread running a CPU other than 0. The thread gets its
+ * own signal stack and preemption timer, then enters the CPU's scheduler
+ * @param arg, pointer to the CPU
+ */
+void *runCpu(void *arg) {
+    localCpu = arg;
+    kernelLock();
+    setSignalStack();
+    createTickTimer(&localCpu->timer);
+
+    // the first scheduler pass looks for work rather than an exited process
+    localCpu->timeExpired = true;
+    contextRestart(&localCpu->schedulerContext);
+    return NULL;
+}
+#endif
+
+/*
+ * Function for starting the host threads of CPUs other than 0. They wait for the
+ * kernel lock, so the caller must hold it until CPU 0 runs a process
+ */
+void startCpus(void) {
+#if SMP_CPUS > 1
+    for (int i = 1; i < SMP_CPUS; i++) {
+        if (pthread_create(&cpus[i].thread, NULL, runCpu, &cpus[i]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+#endif
 }
 
 /*
@@ -500,31 +1175,61 @@ void startKernel(void) {
 
     // create process table, asleep queue, and scheduler queue
     processTable = queueInit();
-    asleep = queueInit();
-    s = schedulerInit();
+    pidIndex = pidMapInit();
+    asleep = sleepHeapInit();
+    terminalInit(&console);
+
+    // take the scheduling policy for this instance from the environment if set
+    schedulerPolicy *policy = &priorityPolicy;
+    char *policyEnv = getenv("PENNOS_SCHED");
+    if (policyEnv != NULL && findSchedulerPolicy(policyEnv) == NULL) {
+        printf("PENNOS_SCHED must be priority or stride, using %s\n", policy->name);
+    } else if (policyEnv != NULL) {
+        policy = findSchedulerPolicy(policyEnv);
+    }
 
-    // create scheduler context
+    // create the run queues, scheduler context and idle context of every CPU
     char *argv[2] = {"schedule", NULL};
-    makeContext(&schedulerContext, schedule, argv);
-
-    // create idle context
-    inIdle = false;
     char *argv1[2] = {"idle", NULL};
-    makeContext(&idleContext, idle, argv1);
+    for (int i = 0; i < SMP_CPUS; i++) {
+        cpu_t *cpu = &cpus[i];
+        cpu->id = i;
+        cpu->s = schedulerInit(policy);
+        cpu->currProcess = NULL;
+        cpu->inIdle = false;
+        cpu->timeExpired = false;
+        cpu->releaseProcess = false;
+        cpu->preempted = false;
+        cpu->lockDepth = 0;
+        makeCpuContext(cpu, &cpu->schedulerContext, schedule, argv);
+        makeCpuContext(cpu, &cpu->idleContext, idle, argv1);
+    }
+#if SMP_CPUS > 1
+    localCpu = &cpus[0];
+#endif
+
+    // take the quantum for this instance from the environment if set
+    char *quantumEnv = getenv("PENNOS_QUANTUM");
+    if (quantumEnv != NULL && (atoi(quantumEnv) < MIN_QUANTUM || atoi(quantumEnv) > MAX_QUANTUM)) {
+        printf("PENNOS_QUANTUM must be between %d and %d ms, using %d\n", MIN_QUANTUM, MAX_QUANTUM, QUANTUM);
+    } else if (quantumEnv != NULL) {
+        quantumLength = atoi(quantumEnv);
+    }
 
-    // set alarm handler and timer
+    // set stack overflow handler, alarm handler and timer
+    setOverflowHandler();
     setAlarmHandler();
     setTimer();
 }
 
 void setForeground (pid_t pid) {
-    node *n = queueSearch(processTable, newNode(pid, NULL));
+    node *n = findProcess(pid);
     if (n != NULL) {
         foregroundProcess = n;
         if (n->pid != 1) {
-            node *parent = queueSearch(processTable, newNode(n->pcb->ppid, NULL));
+            node *parent = findProcess(n->pcb->ppid);
             // block parent
-            parent->pcb->status = BLOCKED;
+            setProcessStatus(parent->pcb, BLOCKED);
             fprintf(logFile, "[%d] BLOCKED %d %d %s\n", numTicks, parent->pid, parent->pcb->priority_level, parent->pcb->name);
         }
     }
@@ -574,36 +1279,44 @@ int main(int argc, char *argv[]) {
     startKernel();
 
     // initialize the shell process
-    pcb_t *process = malloc(sizeof(pcb_t));
+    pcb_t *process = kernelAlloc(sizeof(pcb_t));
     process->ppid = 1;
     process->pgid = 1;
     process->status = READY;
-    process->prevStatus = READY;
     process->priority_level = -1;
     process->pid = 1;
     process->ticksLeft = -1;
-    process->child_pids = NULL;
-    process->zombies = NULL;
+    process->wakeTick = 0;
+    process->sleepIndex = -1;
     process->waitedOn = false;
     process->name = "shell";
-    process->stdin = STDIN_FILENO;
-    process->stdout = STDOUT_FILENO;
+    for (int fd = 0; fd < FD_TABLE_SIZE; fd++) {
+        process->fds[fd] = NULL;
+    }
+    fdSet(process, STDIN_FILENO, container->terminalIn);
+    fdSet(process, STDOUT_FILENO, container->terminalOut);
+    process->cpu = 0;
+    process->lockDepth = 1;
+    process->pass = 0;
+    initProcessLinks(process);
 
     // set the process' context to run the shell
     char *shellArgs[2] = {"shell", NULL};
-    makeContext(&(process->context), shell, shellArgs);
+    makeProcessContext(process, shell, shellArgs, 0);
 
     // add shell process to process table and scheduler queue
-    node *n1 = newNode(process->pid, process);
-    queuePush(processTable, n1);
-    node *n2 = newNode(process->pid, process);
-    addToScheduler(n2, s);
+    queuePush(processTable, &process->tableNode);
+    pidMapInsert(pidIndex, &process->tableNode);
+    addToScheduler(process, getScheduler(0));
 
     fprintf(logFile, "[%d] CREATED %d %d %s\n", numTicks, process->pid, process->priority_level, process->name);
 
+    // start the other CPUs, which wait for the kernel lock until the shell runs here
+    kernelLock();
+    startCpus();
+
     // initialize the current process and start running it
     queue *processTable = getProcessTable();
     foregroundProcess = processTable->front;
-    currProcess = processTable->front;
-    setcontext(&(currProcess->pcb->context));
+    resumeProcess(processTable->front);
 }
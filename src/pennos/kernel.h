@@ -1,6 +1,10 @@
 #ifndef KERNEL_HEADER
 #define KERNEL_HEADER
 
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
 #include "PCB.h"
 #include "queue.h"
 #include "../fs/fat.h"
@@ -14,6 +18,55 @@
 // Global variable for the mounted file system
 fat *mountedFat;
 
+/**
+ * A virtual CPU. Each one runs its own scheduler loop over its own run queues, on
+ * its own host thread. CPU 0 is the main thread and keeps the clock
+ */
+typedef struct cpuTag {
+    int id; // The index of this CPU
+    scheduler *s; // The run queues of this CPU
+    node *currProcess; // The process this CPU is running, NULL while idle
+    context_t schedulerContext; // The context running this CPU's scheduler
+    context_t idleContext; // The context this CPU idles in
+    bool inIdle; // Whether this CPU is idle
+    bool timeExpired; // Whether the scheduler was entered by a switch rather than a returning process
+    bool releaseProcess; // Whether currProcess was cleaned up while running here, so its stack and PCB are released once it is switched out
+    bool preempted; // Whether currProcess was switched out by a tick, so it is charged for its quantum
+    volatile int lockDepth; // How many times the host thread holds the kernel lock
+    timer_t timer; // The timer preempting this CPU (CPUs other than 0)
+    pthread_t thread; // The host thread running this CPU
+} cpu_t;
+
+/*
+ * Getter function for getting the CPU the calling code runs on. A process can move
+ * to another CPU whenever it is switched out, so this must be called again after a switch
+ * @return the pointer to the CPU
+ */
+cpu_t *thisCpu();
+
+/*
+ * Function for taking the big kernel lock, which guards the process table, run queues,
+ * sleep heap and file system when SMP_CPUS > 1. It can be taken again by the same
+ * CPU, and a CPU holding it is not preempted. Does nothing on a uniprocessor
+ */
+void kernelLock();
+
+/*
+ * Function for releasing the big kernel lock once
+ */
+void kernelUnlock();
+
+/*
+ * Cleanup function releasing the kernel lock taken by KERNEL_ENTER
+ * @param entry, the variable declared by KERNEL_ENTER
+ */
+void kernelLeave(int *entry);
+
+/*
+ * Takes the kernel lock until the enclosing block is left, on every return path
+ */
+#define KERNEL_ENTER int kernelEntry __attribute__((cleanup(kernelLeave))) = (kernelLock(), 0)
+
 /*
  * Kernel level function for creating a new child process and adding it to the process table 
  * @param parent a pointer the pcb of the parent
@@ -21,6 +74,14 @@ fat *mountedFat;
  */
 pcb_t *k_process_create(pcb_t *parent);
 
+/*
+ * Function for changing the status of a process. Adds the process to its scheduler
+ * run queue when it becomes READY and removes it when it leaves READY
+ * @param process, pointer to the process
+ * @param status, the new status (READY, BLOCKED, STOPPED, SIGNALED, EXITED)
+ */
+void setProcessStatus(pcb_t *process, int status);
+
 /*
  * Function for zombiefying a given process
  * @param process, pointer to the process 
@@ -42,7 +103,7 @@ void k_process_kill(pcb_t *process, int signal);
 void k_process_cleanup(pcb_t *process);
 
 /*
- * Function for terminating and cleaning all children and zombies of a given parent process
+ * Function for terminating and cleaning all children of a given parent process, zombies included
  * @param process, pointer to the parent process 
  */
 void clearZombiesAndChildren(pcb_t *process);
@@ -64,6 +125,14 @@ pcb_t *getForegroundProcess();
  */
 pcb_t *getCurrProcess();
 
+/*
+ * Function for looking up a process in the process table by pid, without
+ * searching the table or allocating
+ * @param pid, the pid of the process
+ * @return the process table node of the process, or NULL if there is none
+ */
+node *findProcess(pid_t pid);
+
 /*
  * Getter function for getting the process table
  * @return the pointer to the process table
@@ -77,18 +146,41 @@ queue *getProcessTable();
 int getNumTicks();
 
 /*
- * Getter function for getting the scheduler
+ * Function for allocating kernel memory. Allocations are counted, so the kernel
+ * can be checked for allocating in steady state
+ * @param size, the number of bytes to allocate
+ * @return a pointer to the memory, or NULL if it could not be allocated
+ */
+void *kernelAlloc(size_t size);
+
+/*
+ * Getter function for getting the number of allocations the kernel has made
+ * @return the number of allocations
+ */
+int getKernelAllocs();
+
+/*
+ * Getter function for getting the number of allocations the kernel made during the last tick
+ * @return the number of allocations
+ */
+int getTickAllocs();
+
+/*
+ * Getter function for getting the scheduler of a CPU
+ * @param cpu, the index of the CPU (0 to SMP_CPUS - 1)
  * @return the pointer to the scheduler
  */
-scheduler *getScheduler();
+scheduler *getScheduler(int cpu);
 
 /*
- * Function for creating a context using the given function and arguments
- * @param ucp, pointer to the ucontext_t struct which will store the new context
+ * Function for creating the context of a process using the given function and arguments,
+ * on a pooled stack. The process ends when func returns
+ * @param process, pointer to the process whose context and stack are set
  * @param func, pointer to the function to be associated with the new context
  * @param argv, pointer to array of arguments to be passed to func
+ * @param stackSize, the stack size in bytes, or 0 for the default
  */
-void makeContext(ucontext_t *ucp,  void (*func)(), char *argv[]);
+void makeProcessContext(pcb_t *process, void (*func)(), char *argv[], size_t stackSize);
 
 /*
  * Forces a context switch which runs the scheduler's next process, or the idle process if no process is ready.
@@ -96,10 +188,47 @@ void makeContext(ucontext_t *ucp,  void (*func)(), char *argv[]);
 void switchContext(int signum);
 
 /*
- * Function for adding a process to the sleep queue
- * @param n, pointer to node containing the sleep process
+ * Getter function for getting the length of a clock tick
+ * @return the quantum in milliseconds
+ */
+int getQuantum();
+
+/*
+ * Function for changing the length of a clock tick at runtime. The ticks left
+ * for sleeping processes are rescaled so they still wake after the same time
+ * @param ms, the new quantum in milliseconds (MIN_QUANTUM to MAX_QUANTUM)
+ * @return SUCCESS, or FAILURE if ms is out of range
  */
-void addToAsleep(node *n);
+int setQuantum(int ms);
+
+/*
+ * Getter function for getting the scheduling policy in use
+ * @return the name of the policy
+ */
+char *getSchedulingPolicy();
+
+/*
+ * Function for switching every CPU to another scheduling policy at runtime. READY
+ * processes stay queued, in the order the old policy would have run them
+ * @param name, the name of the policy ("priority" or "stride")
+ * @return SUCCESS, or FAILURE if there is no policy with that name
+ */
+int setSchedulingPolicy(char *name);
+
+/*
+ * Function for reading terminal input through the kernel's buffer. The calling process
+ * is BLOCKED until input arrives, so other processes keep running while it waits
+ * @param buf, the buffer to read into
+ * @param n, the most bytes to read
+ * @return the number of bytes read, which is at most one line, or 0 at the end of input
+ */
+int terminalRead(uint8_t *buf, int n);
+
+/*
+ * Function for arming the wake up of a sleep process, ticksLeft ticks from now
+ * @param process, pointer to the sleep process
+ */
+void addToAsleep(pcb_t *process);
 
 /*
  * Function for setting the foreground process
@@ -120,12 +249,24 @@ void unblockParent(pid_t ppid);
 FILE *getLogfile();
 
 /*
- * Helper method for recursively traversing the zombies and children of each 
- * (grand)child of a given process. Used only by p_waitpid with pid<=0
- * @param process, pointer to the parent process
- * @param wstatus, pointer to the status variable for the process to be found
- * @return the pid of the process whose status was changed
+ * Function for blocking the calling process on a wait queue until wakeUp is called on
+ * it. The process also leaves the queue if it is stopped, continued or killed meanwhile,
+ * so callers check again for what they waited for once this returns
+ * @param waitQueue, the wait queue, linking processes through their waitNode
+ */
+void waitOn(queue *waitQueue);
+
+/*
+ * Function for unblocking every process waiting on a wait queue
+ * @param waitQueue, the wait queue
+ */
+void wakeUp(queue *waitQueue);
+
+/*
+ * Function for taking back the event a child posted to its parent, once it has been
+ * waited on or no longer applies
+ * @param process, pointer to the child
  */
-pid_t traverseChild(pcb_t *process, int *wstatus);
+void withdrawChildEvent(pcb_t *process);
 
 #endif
\ No newline at end of file
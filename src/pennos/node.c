@@ -13,13 +13,17 @@ node *newNode(pid_t pid, pcb_t *pcb) {
         return NULL;
     }
 
-    result->pid = pid;
-    result->pcb = pcb;
+    nodeInit(result, pid, pcb);
+    return result;
+}
+
+void nodeInit(node *n, pid_t pid, pcb_t *pcb) {
+    n->pid = pid;
+    n->pcb = pcb;
 
     // initialize prev/next pointers
-    result->next = NULL;
-    result->prev = NULL;
-    return result;
+    n->next = NULL;
+    n->prev = NULL;
 }
 
 void freenode(node* n) {
@@ -1,14 +1,16 @@
-#include <stdbool.h>
-#include "PCB.h"
-
 #ifndef node_HEADER
 #define node_HEADER
 
+#include <stdbool.h>
+#include <sys/types.h>
+
 /**
  * @file node.h
  * @brief Defines a linked process node that contains a PCB and a PID
  */
 
+struct pcbType;
+
 /**
  * A node with pointers to next/prev nodes to allow a linked-list of nodes
  *
@@ -16,7 +18,7 @@
  *
  */
 typedef struct nodeTag {
-    pcb_t *pcb;
+    struct pcbType *pcb;
     pid_t pid;
     // linked list prev pointer
     struct nodeTag* prev;
@@ -29,7 +31,15 @@ typedef struct nodeTag {
  * @param  pid  pid of the process
  * @return      a pointer to the node
  */
-node *newNode(pid_t pid, pcb_t *pcb);
+node *newNode(pid_t pid, struct pcbType *pcb);
+
+/**
+ * Initializes a node embedded in another structure, such as the list links of a PCB
+ * @param n    a pointer to the node
+ * @param pid  pid of the process
+ * @param pcb  the process the node links into lists
+ */
+void nodeInit(node *n, pid_t pid, struct pcbType *pcb);
 
 /**
  * Frees a node
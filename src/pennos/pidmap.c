@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "pidmap.h"
+
+#include "../include/macros.h"
+
+/**
+ * @brief      Gets the home slot of a pid using Fibonacci hashing
+ *
+ * @param      map   The pid index
+ * @param      pid   The pid
+ *
+ * @return     The index of the first slot to probe
+ */
+int getPidSlot(pidMap *map, pid_t pid) {
+    return (int) (((uint32_t) pid * 2654435761u) & (uint32_t) (map->capacity - 1));
+}
+
+/**
+ * @brief      Doubles the number of slots and reinserts every indexed node
+ *
+ * @param      map   The pid index
+ *
+ * @return     0 on success, -1 if allocation failed
+ */
+int growPidMap(pidMap *map) {
+    node **old = map->slots;
+    int oldCapacity = map->capacity;
+
+    node **slots = calloc(oldCapacity * 2, sizeof(node *));
+    if (slots == NULL) {
+        return -1;
+    }
+
+    map->slots = slots;
+    map->capacity = oldCapacity * 2;
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i] != NULL) {
+            int slot = getPidSlot(map, old[i]->pid);
+            while (map->slots[slot] != NULL) {
+                slot = (slot + 1) & (map->capacity - 1);
+            }
+            map->slots[slot] = old[i];
+        }
+    }
+
+    free(old);
+    return 0;
+}
+
+pidMap *pidMapInit() {
+    // allocate memory for this index
+    pidMap *map = malloc(sizeof(pidMap));
+    if (map == NULL) {
+        return NULL;
+    }
+
+    map->slots = calloc(PID_INDEX_MIN_SIZE, sizeof(node *));
+    if (map->slots == NULL) {
+        free(map);
+        return NULL;
+    }
+    map->capacity = PID_INDEX_MIN_SIZE;
+    map->count = 0;
+    return map;
+}
+
+int pidMapInsert(pidMap *map, node *n) {
+    if (map == NULL || n == NULL) {
+        return -1;
+    }
+
+    // keep the load factor at or below one half
+    if ((map->count + 1) * 2 > map->capacity && growPidMap(map) == -1) {
+        return -1;
+    }
+
+    int slot = getPidSlot(map, n->pid);
+    while (map->slots[slot] != NULL) {
+        if (map->slots[slot]->pid == n->pid) {
+            map->slots[slot] = n;
+            return 0;
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+
+    map->slots[slot] = n;
+    map->count++;
+    return 0;
+}
+
+node *pidMapFind(pidMap *map, pid_t pid) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    // probe until the pid or an empty slot is found
+    int slot = getPidSlot(map, pid);
+    while (map->slots[slot] != NULL) {
+        if (map->slots[slot]->pid == pid) {
+            return map->slots[slot];
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return NULL;
+}
+
+void pidMapRemove(pidMap *map, pid_t pid) {
+    if (map == NULL) {
+        return;
+    }
+
+    int mask = map->capacity - 1;
+    int slot = getPidSlot(map, pid);
+    while (map->slots[slot] != NULL && map->slots[slot]->pid != pid) {
+        slot = (slot + 1) & mask;
+    }
+    if (map->slots[slot] == NULL) {
+        return;
+    }
+
+    // shift back later entries of the probe run whose home slot is not
+    // between the hole and their current slot
+    int hole = slot;
+    int next = (hole + 1) & mask;
+    while (map->slots[next] != NULL) {
+        int home = getPidSlot(map, map->slots[next]->pid);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            map->slots[hole] = map->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    map->slots[hole] = NULL;
+    map->count--;
+}
+
+void pidMapDestroy(pidMap *map) {
+    if (map != NULL) {
+        free(map->slots);
+        free(map);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef PIDMAP_HEADER
+#define PIDMAP_HEADER
+
+#include <sys/types.h>
+#include "node.h"
+
+/**
+ * @file pidmap.h
+ * @brief Defines an open-addressed hash index from pids to process table nodes
+ */
+
+/**
+ * A pid index using linear probing. The capacity is always a power of two and is
+ * doubled when the table becomes half full, so lookups stay O(1) as the process
+ * table grows. Removal shifts later entries back, so no tombstones are needed.
+ * The index does not own the nodes it points to.
+ */
+typedef struct {
+    node **slots; // The indexed nodes, NULL for empty slots
+    int capacity; // The number of slots
+    int count; // The number of indexed nodes
+} pidMap;
+
+/**
+ * Allocates and initializes an empty pid index
+ * @return a pointer to the new index, or NULL if failed to allocate memory
+ */
+pidMap *pidMapInit();
+
+/**
+ * Indexes a node by its pid, replacing any node already indexed under that pid
+ * @param map the pid index
+ * @param n the node to index
+ * @return 0 on success, -1 if the index failed to grow
+ */
+int pidMapInsert(pidMap *map, node *n);
+
+/**
+ * Looks up a node by pid without allocating
+ * @param map the pid index
+ * @param pid the pid to look up
+ * @return the node indexed under pid, or NULL if there is none
+ */
+node *pidMapFind(pidMap *map, pid_t pid);
+
+/**
+ * Removes the node indexed under a pid, if any
+ * @param map the pid index
+ * @param pid the pid to remove
+ */
+void pidMapRemove(pidMap *map, pid_t pid);
+
+/**
+ * Frees a pid index (but not the nodes it points to)
+ * @param map the pid index to free
+ */
+void pidMapDestroy(pidMap *map);
+
+#endif
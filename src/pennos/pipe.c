@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <signal.h>
+
+#include "pipe.h"
+#include "kernel.h"
+
+pipeBuffer *newPipe() {
+    pipeBuffer *p = malloc(sizeof(pipeBuffer));
+
+    if (p == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    p->head = 0;
+    p->count = 0;
+    p->readers = 1;
+    p->writers = 1;
+    p->readWait = (queue) { .count = 0, .front = NULL, .back = NULL };
+    p->writeWait = (queue) { .count = 0, .front = NULL, .back = NULL };
+    return p;
+}
+
+int pipeRead(pipeBuffer *p, uint8_t *buf, int n) {
+    // keep the clock from preempting between the check and waiting, or a writer could
+    // add data in between and wake nobody
+    sigset_t mask, old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &old);
+
+    while (p->count == 0 && p->writers > 0) {
+        // block until a writer adds data or closes the last write end
+        waitOn(&p->readWait);
+    }
+
+    sigprocmask(SIG_SETMASK, &old, NULL);
+
+    int taken = 0;
+    while (taken < n && p->count > 0) {
+        buf[taken++] = p->data[p->head];
+        p->head = (p->head + 1) % PIPE_BUFFER_SIZE;
+        p->count--;
+    }
+
+    // the space just freed lets blocked writers continue
+    if (taken > 0) {
+        wakeUp(&p->writeWait);
+    }
+    return taken;
+}
+
+int pipeWrite(pipeBuffer *p, uint8_t *buf, int n) {
+    sigset_t mask, old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+
+    int written = 0;
+    while (written < n) {
+        // as in pipeRead, a reader must not make space between the check and waiting
+        sigprocmask(SIG_BLOCK, &mask, &old);
+        while (p->count == PIPE_BUFFER_SIZE && p->readers > 0) {
+            // block until a reader makes space or closes the last read end
+            waitOn(&p->writeWait);
+        }
+        sigprocmask(SIG_SETMASK, &old, NULL);
+
+        // nobody can ever read what is left
+        if (p->readers == 0) {
+            return written > 0 ? written : FAILURE;
+        }
+
+        while (written < n && p->count < PIPE_BUFFER_SIZE) {
+            p->data[(p->head + p->count) % PIPE_BUFFER_SIZE] = buf[written++];
+            p->count++;
+        }
+
+        // readers can continue with what was written so far
+        wakeUp(&p->readWait);
+    }
+    return written;
+}
+
+void pipeClose(pipeBuffer *p, bool writeEnd) {
+    if (writeEnd) {
+        p->writers--;
+        // readers of an empty pipe see the end of input once no writer is left
+        wakeUp(&p->readWait);
+    } else {
+        p->readers--;
+        wakeUp(&p->writeWait);
+    }
+
+    if (p->readers == 0 && p->writers == 0) {
+        free(p);
+    }
+}
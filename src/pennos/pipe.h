@@ -0,0 +1,62 @@
+#ifndef PIPE_HEADER
+#define PIPE_HEADER
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "queue.h"
+#include "../include/macros.h"
+
+/**
+ * @file pipe.h
+ * @brief Defines the kernel's pipes, fixed-size buffers connecting a writing process to a reading one
+ */
+
+/**
+ * A ring buffer owned by the kernel, reached through a read descriptor and a write
+ * descriptor. A reader of an empty pipe is BLOCKED on readWait until data is written
+ * or the last write end is closed, and a writer of a full pipe is BLOCKED on
+ * writeWait until data is read or the last read end is closed.
+ */
+typedef struct {
+    uint8_t data[PIPE_BUFFER_SIZE]; // The buffered data
+    int head; // The position of the first unread byte in data
+    int count; // The number of unread bytes
+    int readers; // The number of open read ends
+    int writers; // The number of open write ends
+    queue readWait; // The processes waiting for data, linked through their waitNode
+    queue writeWait; // The processes waiting for space, linked through their waitNode
+} pipeBuffer;
+
+/**
+ * Allocates an empty pipe with one read end and one write end open
+ * @return the pipe, or NULL if it could not be allocated
+ */
+pipeBuffer *newPipe();
+
+/**
+ * Reads up to n bytes, blocking while the pipe is empty and a write end is open
+ * @param p the pipe
+ * @param buf the buffer to copy the data into
+ * @param n the most bytes to read
+ * @return the number of bytes read, 0 once the pipe is empty and every write end is closed
+ */
+int pipeRead(pipeBuffer *p, uint8_t *buf, int n);
+
+/**
+ * Writes n bytes, blocking while the pipe is full and a read end is open
+ * @param p the pipe
+ * @param buf the buffer to copy the data from
+ * @param n the number of bytes to write
+ * @return the number of bytes written, or FAILURE if every read end is closed before any are
+ */
+int pipeWrite(pipeBuffer *p, uint8_t *buf, int n);
+
+/**
+ * Closes one end of the pipe, waking the processes waiting on the other end. The
+ * pipe is freed once both ends are closed
+ * @param p the pipe
+ * @param writeEnd whether the write end is closed, otherwise the read end
+ */
+void pipeClose(pipeBuffer *p, bool writeEnd);
+
+#endif
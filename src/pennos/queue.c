@@ -71,6 +71,35 @@ node *queuePush(queue *q, node *n) {
     return n;
 }
 
+node *queueInsertAfter(queue *q, node *after, node *n) {
+    // check if the input queue and n are initialized
+    if (q == NULL || n == NULL) {
+        return NULL;
+    }
+
+    // inserting after the back is a push
+    if (after == q->back) {
+        return queuePush(q, n);
+    }
+
+    // link n in between after (or the front) and the node that follows it
+    node *next = after == NULL ? q->front : after->next;
+    n->prev = after;
+    n->next = next;
+    next->prev = n;
+    if (after == NULL) {
+        q->front = n;
+    } else {
+        after->next = n;
+    }
+
+    // increment node counter
+    q->count = q->count + 1;
+
+    // return the node
+    return n;
+}
+
 node *queuePop(queue *q) {
     // check if the input queue is initialized
     if (q == NULL) {
@@ -48,6 +48,15 @@ node *queueFront(queue *q);
  */
 node *queuePush(queue *q, node *n);
 
+/**
+ * Inserts a node right after another node of the queue
+ * @param  q     a pointer to the queue
+ * @param  after a pointer to the node to insert after, or NULL to insert at the front
+ * @param  n     a pointer to the node to add
+ * @return   a pointer to the node just added, or null if the queue is uninitialized
+ */
+node *queueInsertAfter(queue *q, node *after, node *n);
+
 /**
  * Removes a node from the front of the queue
  * @param  q a pointer to the queue
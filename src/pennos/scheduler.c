@@ -1,26 +1,220 @@
 #include <ucontext.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "queue.h"
 #include "node.h"
 #include "kernel.h"
-
-#define READY 0
-#define BLOCKED 1
-#define RUNNING 2
+#include "scheduler.h"
+#include "../include/macros.h"
 
 int curr = -1;
 
-// iterate through queue returning first running process else return NULL
-node *iterate(queue *q) {
-    node *currProcess = q->front;
-    while (currProcess != NULL && currProcess->pcb->status != READY) {
-        currProcess = currProcess->next;
+/**
+ * @brief      Gets the index (0 high, 1 med, 2 low) of the run queue for a priority level
+ *
+ * @param      priority  The priority level of a process (-1, 0 or 1)
+ *
+ * @return     The index of the run queue
+ */
+int getLevelIndex(int priority) {
+    if (priority == -1) {
+        return 0;
+    } else if (priority == 0) {
+        return 1;
+    }
+    return 2;
+}
+
+/**
+ * @brief      Gets the run queue for a priority level
+ *
+ * @param      priority  The priority level of a process (-1, 0 or 1)
+ * @param      s         Pointer to the scheduler
+ *
+ * @return     Pointer to the run queue
+ */
+queue *getLevelQueue(int priority, scheduler *s) {
+    queue *arr[3] = {s->high, s->med, s->low};
+    return arr[getLevelIndex(priority)];
+}
+
+/**
+ * @brief      Resets the 9/6/4 policy's turn counter and level bitmap
+ *
+ * @param      s     Pointer to the scheduler
+ */
+void priorityInit(scheduler *s) {
+    s->quantaCount = 0;
+    s->readyLevels = 0;
+}
+
+/**
+ * @brief      Adds a process to the back of the run queue for its priority and
+ *             marks that level non-empty
+ *
+ * @param      process  Pointer to the pcb of the process
+ * @param      s        Pointer to the scheduler
+ */
+void priorityEnqueue(pcb_t *process, scheduler *s) {
+    queuePush(getLevelQueue(process->priority_level, s), &process->runNode);
+    s->readyLevels |= 1u << getLevelIndex(process->priority_level);
+}
+
+/**
+ * @brief      Unlinks a process from its run queue and clears the level bit once
+ *             the queue empties
+ *
+ * @param      process  Pointer to the pcb of the process
+ * @param      s        Pointer to the scheduler
+ */
+void priorityDequeue(pcb_t *process, scheduler *s) {
+    queue *q = getLevelQueue(process->priority_level, s);
+    queueRemoveNode(q, &process->runNode);
+    if (q->count == 0) {
+        s->readyLevels &= ~(1u << getLevelIndex(process->priority_level));
     }
+}
+
+/**
+ * @brief      Picks the level whose turn it is from the non-empty level bitmap and
+ *             rotates its front process to the back, without searching or allocating
+ *
+ * @param      s     Pointer to the scheduler
+ *
+ * @return     The next process to run, or NULL if no level has a process
+ */
+node *priorityPick(scheduler *s) {
+
+    int quantaCount = s->quantaCount;
+    s->quantaCount = (quantaCount + 1) % (HIGH_SHARE + MED_SHARE + LOW_SHARE);
+
+    // return NULL (idle) since no queues have ready processes
+    if (s->readyLevels == 0) {
+        return NULL;
+    }
+
+    int startIdx = 0;
+
+    if (quantaCount >= 0 && quantaCount < HIGH_SHARE)
+        startIdx = 0;
+    else if (quantaCount >= HIGH_SHARE && quantaCount < HIGH_SHARE + MED_SHARE)
+        startIdx = 1;
+    else
+        startIdx = 2;
+
+    // rotate the level bitmap so the level whose turn it is comes first, then
+    // take the first non-empty level from there
+    unsigned int rotated = ((s->readyLevels >> startIdx) | (s->readyLevels << (3 - startIdx))) & 7u;
+    int idx = (startIdx + __builtin_ctz(rotated)) % 3;
+    queue *arr[3] = {s->high, s->med, s->low};
+
+    // add the process back to the queue in a round-robin fashion
+    node *currProcess = queuePop(arr[idx]);
+    queuePush(arr[idx], currProcess);
+
     return currProcess;
 }
 
-scheduler *schedulerInit() {
+schedulerPolicy priorityPolicy = {
+    .name = "priority",
+    .init = priorityInit,
+    .enqueue = priorityEnqueue,
+    .dequeue = priorityDequeue,
+    .pick = priorityPick,
+    .tick = NULL
+};
+
+/**
+ * @brief      Gets the stride of a process, the pass it is charged per quantum
+ *
+ * @param      process  Pointer to the pcb of the process
+ *
+ * @return     The stride, inversely proportional to the weight of its priority level
+ */
+long long getStride(pcb_t *process) {
+    int weights[3] = {HIGH_SHARE, MED_SHARE, LOW_SHARE};
+    return STRIDE_BASE / weights[getLevelIndex(process->priority_level)];
+}
+
+/**
+ * @brief      Resets the stride policy's virtual time
+ *
+ * @param      s     Pointer to the scheduler
+ */
+void strideInit(scheduler *s) {
+    s->virtualTime = 0;
+}
+
+/**
+ * @brief      Inserts a process into the stride queue by pass, after processes with
+ *             the same pass. A process that was not queued is first caught up to the
+ *             virtual time, so sleeping does not bank CPU time. The search starts at
+ *             the back, where a process that just ran belongs
+ *
+ * @param      process  Pointer to the pcb of the process
+ * @param      s        Pointer to the scheduler
+ */
+void strideEnqueue(pcb_t *process, scheduler *s) {
+    if (process->pass < s->virtualTime) {
+        process->pass = s->virtualTime;
+    }
+
+    node *after = s->byPass->back;
+    while (after != NULL && after->pcb->pass > process->pass) {
+        after = after->prev;
+    }
+    queueInsertAfter(s->byPass, after, &process->runNode);
+}
+
+/**
+ * @brief      Unlinks a process from the stride queue
+ *
+ * @param      process  Pointer to the pcb of the process
+ * @param      s        Pointer to the scheduler
+ */
+void strideDequeue(pcb_t *process, scheduler *s) {
+    queueRemoveNode(s->byPass, &process->runNode);
+}
+
+/**
+ * @brief      Picks the process with the lowest pass and advances the virtual time to it
+ *
+ * @param      s     Pointer to the scheduler
+ *
+ * @return     The next process to run, or NULL if none is queued
+ */
+node *stridePick(scheduler *s) {
+    node *next = queueFront(s->byPass);
+    if (next != NULL) {
+        s->virtualTime = next->pcb->pass;
+    }
+    return next;
+}
+
+/**
+ * @brief      Charges a process one stride for the quantum it ran and moves it back
+ *             behind the processes it has now passed
+ *
+ * @param      process  Pointer to the pcb of the process
+ * @param      s        Pointer to the scheduler
+ */
+void strideTick(pcb_t *process, scheduler *s) {
+    strideDequeue(process, s);
+    process->pass += getStride(process);
+    strideEnqueue(process, s);
+}
+
+schedulerPolicy stridePolicy = {
+    .name = "stride",
+    .init = strideInit,
+    .enqueue = strideEnqueue,
+    .dequeue = strideDequeue,
+    .pick = stridePick,
+    .tick = strideTick
+};
+
+scheduler *schedulerInit(schedulerPolicy *policy) {
 
     // allocate memory for scheduler
     scheduler *newScheduler = malloc(sizeof(scheduler));
@@ -31,213 +225,117 @@ scheduler *schedulerInit() {
     }
 
     // initialize variables
+    newScheduler->policy = policy;
     newScheduler->quantaCount = 0;
+    newScheduler->readyLevels = 0;
     newScheduler->high = queueInit();
     newScheduler->med = queueInit();
     newScheduler->low = queueInit();
+    newScheduler->byPass = queueInit();
+    newScheduler->virtualTime = 0;
+    policy->init(newScheduler);
 
     return newScheduler;
 }
 
-void addToScheduler(node *process, scheduler *s) {
-    // get priotiy of process
-    int priority = process->pcb->priority_level;
+schedulerPolicy *findSchedulerPolicy(char *name) {
+    schedulerPolicy *policies[2] = {&priorityPolicy, &stridePolicy};
+    for (int i = 0; i < 2; i++) {
+        if (strcmp(policies[i]->name, name) == 0) {
+            return policies[i];
+        }
+    }
+    return NULL;
+}
 
-    // add to appropriate queue
-    if (priority == -1) {
-        queuePush(s->high, newNode(process->pid, process->pcb));
-    } else if (priority == 0) {
-        queuePush(s->med, newNode(process->pid, process->pcb));
-    } else {
-        queuePush(s->low, newNode(process->pid, process->pcb));
+void setSchedulerPolicy(scheduler *s, schedulerPolicy *policy) {
+    // take the queued processes out front to back, reusing their run queue nodes
+    queue moving = { .count = 0, .front = NULL, .back = NULL };
+    queue *queues[RUN_QUEUES];
+    getRunQueues(s, queues);
+    for (int i = 0; i < RUN_QUEUES; i++) {
+        while (queues[i]->front != NULL) {
+            pcb_t *process = queues[i]->front->pcb;
+            removeFromScheduler(process, s);
+            queuePush(&moving, &process->runNode);
+        }
     }
 
+    s->policy = policy;
+    policy->init(s);
+
+    while (moving.front != NULL) {
+        addToScheduler(queuePop(&moving)->pcb, s);
+    }
 }
 
-void removeFromScheduler(node *process, scheduler *s) {
-    // get priotiy of process
-    int priority = process->pcb->priority_level;
+void getRunQueues(scheduler *s, queue *queues[RUN_QUEUES]) {
+    queues[0] = s->high;
+    queues[1] = s->med;
+    queues[2] = s->low;
+    queues[3] = s->byPass;
+}
 
-    // remove from appropriate queue
-    if (priority == -1) {
-    	node *n = queueSearch(s->high, process);
-        queueRemoveNode(s->high, n);
-    } else if (priority == 0) {
-    	node *n = queueSearch(s->med, process);
-        queueRemoveNode(s->med, n);
-    } else {
-    	node *n = queueSearch(s->low, process);
-        queueRemoveNode(s->low, n);
+void addToScheduler(pcb_t *process, scheduler *s) {
+    // a process is linked into at most one run queue
+    if (process->runnable) {
+        return;
     }
-}
 
-node *getNextProcess(scheduler *s) {
+    s->policy->enqueue(process, s);
+    process->runnable = true;
+}
 
-    int quantaCount = s->quantaCount;
+void removeFromScheduler(pcb_t *process, scheduler *s) {
+    if (!process->runnable) {
+        return;
+    }
 
-    queue *arr[3] = {s->high, s->med, s->low};
+    s->policy->dequeue(process, s);
+    process->runnable = false;
+}
 
-    int startIdx = 0;
+void setSchedulerPriority(pcb_t *process, int priority, scheduler *s) {
+    // queue a READY process again under its new priority
+    bool runnable = process->runnable;
+    removeFromScheduler(process, s);
+    process->priority_level = priority;
+    if (runnable) {
+        addToScheduler(process, s);
+    }
+}
 
-    if (quantaCount >= 0 && quantaCount < 9)
-        startIdx = 0;
-    else if (quantaCount >= 9 && quantaCount < 15)
-        startIdx = 1;
-    else
-        startIdx = 2;
+node *getNextProcess(scheduler *s) {
+    return s->policy->pick(s);
+}
 
-    for (int i = 0; i < 3; i++) {
-        int newIdx = (startIdx + i) % 3;
-        node *currProcess = iterate(arr[newIdx]);
+void schedulerTick(pcb_t *process, scheduler *s) {
+    // only a process still queued here has a place to be charged in
+    if (s->policy->tick != NULL && process->runnable) {
+        s->policy->tick(process, s);
+    }
+}
 
-        // check med priority queue
-        if (currProcess != NULL) {
-            s->quantaCount = (quantaCount + 1) % 19;
+int getSchedulerLoad(scheduler *s) {
+    return s->high->count + s->med->count + s->low->count + s->byPass->count;
+}
 
-            // add a process back to the queue in a round-robin fashion
-            removeFromScheduler(currProcess, s);
-            addToScheduler(currProcess, s);
+pcb_t *stealFromScheduler(scheduler *s, pcb_t *running) {
+    queue *queues[RUN_QUEUES];
+    getRunQueues(s, queues);
 
-            return currProcess;
+    // take the first process that would run last here, skipping the one the
+    // owning CPU is running
+    for (int idx = 0; idx < RUN_QUEUES; idx++) {
+        node *n = queues[idx]->back;
+        while (n != NULL && n->pcb == running) {
+            n = n->prev;
+        }
+        if (n != NULL) {
+            pcb_t *process = n->pcb;
+            removeFromScheduler(process, s);
+            return process;
         }
     }
-
-    // return NULL (idle) since no queues have ready processes
-    s->quantaCount = (quantaCount + 1) % 19;
     return NULL;
-
-    // select process from high priority queue to run 
-    // if (quantaCount >= 0 && quantaCount < 9) {
-    // 	curr = -1;
-    //     node *currProcess = iterate(s->high);
-
-    //     // check med priority queue
-    //     if (currProcess == NULL) {
-
-    //         // set turn to med priority queue
-    //         s->quantaCount = 9;
-    //         curr = 0;
-    //         currProcess = iterate(s->med);
-
-    //         // check low priority queue
-    //         if (currProcess == NULL) {
-                
-    //             // set turn to low priority queue
-    //             s->quantaCount = 15;
-    //             currProcess = iterate(s->low);
-
-    //             // idle process
-    //             if (currProcess == NULL) {
-    //             	s->quantaCount = (quantaCount + 1) % 19;
-    //                 printf("returning IDLE process 1\n");
-    //                 return NULL;
-    //             // return found process
-    //             } else {
-    //                 s->quantaCount = (quantaCount + 1) % 19;
-
-    //                 // add a process back to the queue in a round-robin fashion
-    //                 removeFromScheduler(currProcess, s);
-    //                 addToScheduler(currProcess, s);
-
-    //                 return currProcess;
-    //             }
-
-    //         // return found process
-    //         } else {
-    //             s->quantaCount = quantaCount + 1;
-
-    //             // add a process back to the queue in a round-robin fashion
-    //             removeFromScheduler(currProcess, s);
-    //             addToScheduler(currProcess, s);
-
-    //             return currProcess;
-    //         }
-        
-    //     // return found process
-    //     } else {
-    //         s->quantaCount = quantaCount + 1;
-
-    //         // add a process back to the queue in a round-robin fashion
-    //         removeFromScheduler(currProcess, s);
-    //         addToScheduler(currProcess, s);
-
-    //         return currProcess;
-    //     }
-        
-    // // select process from med priority queue to run
-    // } else if (quantaCount >= 9 && quantaCount < 15) {
-
-    //     node *currProcess = iterate(s->med);
-
-    //     // check low priority queue
-    //     if (currProcess == NULL) {
-
-    //         // set turn to low priority queue
-    //         s->quantaCount = 15;
-    //         currProcess = iterate(s->low);
-
-    //         // idle process
-    //         if (currProcess == NULL) {
-
-    //             // set turn to high priority queue
-    //             s->quantaCount = 0;
-    //             currProcess = iterate(s->high);
-
-    //             if (currProcess == NULL) {
-    //                 s->quantaCount = (quantaCount + 1) % 19;
-    //                 printf("returning IDLE process 2\n");
-    //                 return NULL;
-    //             } else {
-    //                 s->quantaCount = (quantaCount + 1) % 19;
-
-    //                 // add a process back to the queue in a round-robin fashion
-    //                 removeFromScheduler(currProcess, s);
-    //                 addToScheduler(currProcess, s);
-
-    //                 return currProcess;
-    //             }
-
-    //         // return found process
-    //         } else {
-    //             s->quantaCount = (quantaCount + 1) % 19;
-
-    //             // add a process back to the queue in a round-robin fashion
-    //             removeFromScheduler(currProcess, s);
-	   //          addToScheduler(currProcess, s);
-
-    //             return currProcess;
-    //         }
-
-    //     // return found process
-    //     } else {
-    //         s->quantaCount = (quantaCount + 1) % 19;
-
-    //         // add a process back to the queue in a round-robin fashion
-    //         removeFromScheduler(currProcess, s);
-    //         addToScheduler(currProcess, s);
-
-    //         return currProcess;
-    //     }
-
-    // // select process from low priority queue to run
-    // } else {
-
-    //     node *currProcess = iterate(s->low);
-    //     // idle process
-    //     if (currProcess == NULL) {
-    //     	s->quantaCount = (quantaCount + 1) % 19;
-    //         printf("returning IDLE process 3\n");
-    //         return NULL;
-    //     // return found process
-    //     } else {
-    //         s->quantaCount = (quantaCount + 1) % 19;
-
-    //         // add a process back to the queue in a round-robin fashion
-    //         removeFromScheduler(currProcess, s);
-    //         addToScheduler(currProcess, s);
-
-    //         return currProcess;
-    //     }
-
-    // }
-}
\ No newline at end of file
+}
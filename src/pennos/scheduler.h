@@ -9,43 +9,151 @@
  * @brief Contains the scheduler runqueues as well as functions to interact with a scheduler
  */
 
+// The number of run queues a scheduler has, over all policies
+#define RUN_QUEUES 4
+
+struct schedulerPolicyTag;
+
 typedef struct {
+    struct schedulerPolicyTag *policy; // The policy ordering the run queues
     int quantaCount;
+    unsigned int readyLevels; // Bit i is set while run queue i (high, med, low) is non-empty
     queue *high;
     queue *med;
     queue *low;
+    queue *byPass; // The stride policy's run queue, in increasing pass order
+    long long virtualTime; // The pass of the process the stride policy picked last
 } scheduler;
 
+/**
+ * A scheduling policy. The scheduler functions below keep track of which processes
+ * are queued and call into the policy of a scheduler to order them
+ */
+typedef struct schedulerPolicyTag {
+    char *name; // The name the policy is selected by
+    void (*init)(scheduler *s); // Resets the policy's state, with no process queued
+    void (*enqueue)(pcb_t *process, scheduler *s); // Queues a READY process
+    void (*dequeue)(pcb_t *process, scheduler *s); // Unlinks a queued process
+    node *(*pick)(scheduler *s); // Picks the next process to run, which stays queued
+    void (*tick)(pcb_t *process, scheduler *s); // Charges a process that ran a whole quantum, or NULL
+} schedulerPolicy;
+
+/**
+ * The 9/6/4 policy. In every 19 quanta the high, med and low levels get 9, 6 and 4
+ * turns, and each level is round-robin
+ */
+extern schedulerPolicy priorityPolicy;
+
+/**
+ * The stride policy. Each process has a weight from its priority level (9, 6 or 4)
+ * and a pass that grows by a stride inversely proportional to the weight for every
+ * quantum it runs. The process with the lowest pass runs next
+ */
+extern schedulerPolicy stridePolicy;
+
 /**
  * @brief      Initialize a scheduler
  *
+ * @param      policy  The policy the scheduler starts with
+ *
  * @return     Pointer to a new scheduler in memory, or NULL if it failed to initialize
  */
-scheduler *schedulerInit();
+scheduler *schedulerInit(schedulerPolicy *policy);
 
 /**
- * @brief      Adds a process to the scheduler
+ * @brief      Finds a scheduling policy by name
  *
- * @param      process  Pointer to the process
+ * @param      name  The name of the policy ("priority" or "stride")
+ *
+ * @return     Pointer to the policy, or NULL if there is none with that name
+ */
+schedulerPolicy *findSchedulerPolicy(char *name);
+
+/**
+ * @brief      Switches a scheduler to another policy. The queued processes are
+ *             moved over in the order the old policy would have run them.
+ *
+ * @param      s       Pointer to the scheduler
+ * @param      policy  Pointer to the new policy
+ */
+void setSchedulerPolicy(scheduler *s, schedulerPolicy *policy);
+
+/**
+ * @brief      Gets the run queues of a scheduler, the high, med and low levels and
+ *             then the stride queue. Only the queues of its policy are non-empty.
+ *
+ * @param      s       Pointer to the scheduler
+ * @param      queues  Array filled with the RUN_QUEUES queues
+ */
+void getRunQueues(scheduler *s, queue *queues[RUN_QUEUES]);
+
+/**
+ * @brief      Adds a READY process to the run queues, where the policy orders it.
+ *             Does nothing if the process is already queued. Run queues only ever
+ *             hold READY processes, so this is called on every transition to READY.
+ *
+ * @param      process  Pointer to the pcb of the process
  * @param      s        Pointer to the scheduler
  */
-void addToScheduler(node *process, scheduler *s);
+void addToScheduler(pcb_t *process, scheduler *s);
 
 /**
- * @brief      Removes a process from the scheduler
+ * @brief      Removes a process from its run queue. Does nothing if the process
+ *             is not queued. Called on every transition away from READY.
  *
- * @param      process  Pointer to the process
+ * @param      process  Pointer to the pcb of the process
  * @param      s        Pointer to the scheduler
  */
-void removeFromScheduler(node *process, scheduler *s);
+void removeFromScheduler(pcb_t *process, scheduler *s);
+
+/**
+ * @brief      Changes the priority level of a process, queueing it again under
+ *             the new level if it is READY
+ *
+ * @param      process   Pointer to the pcb of the process
+ * @param      priority  The new priority level (-1, 0 or 1)
+ * @param      s         Pointer to the scheduler
+ */
+void setSchedulerPriority(pcb_t *process, int priority, scheduler *s);
 
 
 /**
- * @brief      Gets the next process the scheduler wants to run
+ * @brief      Gets the next process the scheduler's policy wants to run
  *
  * @param      s     Pointer to the scheduler
  *
  * @return     The next process to run, returns NULL if idle
  */
 node *getNextProcess(scheduler *s);
+
+/**
+ * @brief      Charges a process that was preempted at the end of its quantum,
+ *             for policies that account for CPU time
+ *
+ * @param      process  Pointer to the pcb of the process
+ * @param      s        Pointer to the scheduler
+ */
+void schedulerTick(pcb_t *process, scheduler *s);
+
+/**
+ * @brief      Gets the number of READY processes in a scheduler's run queues
+ *
+ * @param      s     Pointer to the scheduler
+ *
+ * @return     The number of queued processes
+ */
+int getSchedulerLoad(scheduler *s);
+
+/**
+ * @brief      Takes a process out of a scheduler so another CPU can run it. The
+ *             first run queue with a candidate is used, taking the process from
+ *             the back, where it would run last.
+ *
+ * @param      s        Pointer to the scheduler to steal from
+ * @param      running  Pointer to the process the owning CPU is running, which is
+ *                      never taken, or NULL
+ *
+ * @return     The stolen process, no longer in any run queue, or NULL if there is none
+ */
+pcb_t *stealFromScheduler(scheduler *s, pcb_t *running);
 #endif
\ No newline at end of file
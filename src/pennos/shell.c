@@ -8,6 +8,7 @@
 #include "jobcontrol.h"
 #include "iter.h"
 #include "filedescriptor.h"
+#include "../fs/blockdev.h"
 #include "../include/macros.h"
 #include <stdlib.h>
 
@@ -30,7 +31,11 @@ char *commands[] = {
     "ps", 
     "kill -[SIGNAL_NAME] pid ...", 
     "nice_pid priority pid",
-    "nice priority command [arg]"};
+    "nice priority command [arg]",
+    "cachestat",
+    "quantum [ms]",
+    "sched [priority|stride]",
+    "allocstat"};
 
 void busy() {
     while(1) {
@@ -38,7 +43,36 @@ void busy() {
     }
 }
 
+/**
+ * @brief      Copies the first 10 lines of stdin to stdout, then closes stdin so a writer upstream in a pipeline
+ *             sees its reader go away
+ */
+void headStdin() {
+    uint8_t buf[4096];
+    int lines = 0;
+    int bytesRead = 0;
+
+    while (lines < 10 && (bytesRead = f_read(STDIN_FILENO, sizeof(buf), buf)) > 0) {
+        // write up to and including the 10th newline of the input
+        int end = 0;
+        while (end < bytesRead && lines < 10) {
+            if (buf[end++] == '\n')
+                lines++;
+        }
+
+        if (f_write(STDOUT_FILENO, buf, end) == FAILURE)
+            break;
+    }
+
+    f_close(STDIN_FILENO);
+}
+
 void head(char **argv) {
+    if (argv[1] == NULL) {
+        headStdin();
+        return;
+    }
+
     /*
     printf("entered\n");
     
@@ -50,7 +84,7 @@ void head(char **argv) {
     bytes_read =  f_read(fd, 4096, buffer);
     printf("br is %d\n", bytes_read);
     int bytes_written = 0;
-    bytes_written = f_write(getCurrProcess()->stdout, buffer, bytes_read);
+    bytes_written = f_write(STDOUT_FILENO, buffer, bytes_read);
     printf("bw is %d\n", bytes_written);
     int fc = f_close(fd);
     printf("fc is %d\n", fc);
@@ -62,7 +96,7 @@ void head(char **argv) {
         char title_buffer[tb];
         sprintf(title_buffer, "\n==> %s <==\n", argv[count]);
         
-        f_write(getCurrProcess()->stdout, (uint8_t *) title_buffer, tb);
+        f_write(STDOUT_FILENO, (uint8_t *) title_buffer, tb);
         
         int fd = f_open(argv[count], F_READ); 
         //printf("fd is %d\n", fd);       
@@ -101,7 +135,7 @@ void head(char **argv) {
 
 
             int bytes_written = 0;
-            bytes_written = f_write(getCurrProcess()->stdout, buffer_after_count, last_num);
+            bytes_written = f_write(STDOUT_FILENO, buffer_after_count, last_num);
             //printf("bw is %d\n", bytes_written);
             free(buffer_after_count);
         }
@@ -121,7 +155,7 @@ void createSleep(char **argv) {
         // indefinite sleep case
         p_sleep(-2);
     } else {
-        p_sleep(atoi(argv[1]) * 10);
+        p_sleep(atoi(argv[1]) * 1000 / getQuantum());
     }
 
 }
@@ -151,85 +185,32 @@ void man() {
 }
 
 void ps() {
-    scheduler *s = getScheduler();
-    
-    char columns[20];
-    sprintf(columns, "PID PPID PRIORITY\n");
-    write(STDERR_FILENO, columns, strlen(columns));
+    KERNEL_ENTER;
 
-    queue *high = s->high;
-    node *curr = queueFront(high);
-    while (curr != NULL) {
-        if (curr->pcb->status == READY) {
+    char columns[32];
+    sprintf(columns, "PID PPID PRIORITY CPU\n");
+    f_write(STDOUT_FILENO, (uint8_t *) columns, strlen(columns));
 
-            // build output string with pid, ppid, and priority
-            char pid[20];
-            sprintf(pid, "%d ", curr->pcb->pid);
+    // list the run queues of every CPU, in the order its policy keeps them
+    for (int cpu = 0; cpu < SMP_CPUS; cpu++) {
+        queue *queues[RUN_QUEUES];
+        getRunQueues(getScheduler(cpu), queues);
 
-            char ppid[20];
-            sprintf(ppid, "%d ", curr->pcb->ppid);
+        for (int i = 0; i < RUN_QUEUES; i++) {
+            node *curr = queueFront(queues[i]);
+            while (curr != NULL) {
+                if (curr->pcb->status == READY) {
 
-            char priority[20];
-            sprintf(priority, "%d\n", curr->pcb->priority_level);
-
-            strcat(ppid, priority);
-            strcat(pid, ppid);
-            int length = strlen(pid);
-
-            // write to shell
-            write(STDERR_FILENO, pid, length);
-        }
-        curr = curr->next;
-    }
+                    // build output string with pid, ppid, priority and the CPU it last ran on
+                    char line[64];
+                    sprintf(line, "%d %d %d %d\n", curr->pcb->pid, curr->pcb->ppid, curr->pcb->priority_level, curr->pcb->cpu);
 
-    queue *med = s->med;
-    curr = queueFront(med);
-    while (curr != NULL) {
-        if (curr->pcb->status == READY) {
-
-            // build output string with pid, ppid, and priority
-            char pid[20];
-            sprintf(pid, "%d ", curr->pcb->pid);
-
-            char ppid[20];
-            sprintf(ppid, "%d ", curr->pcb->ppid);
-
-            char priority[20];
-            sprintf(priority, "%d\n", curr->pcb->priority_level);
-
-            strcat(ppid, priority);
-            strcat(pid, ppid);
-            int length = strlen(pid);
-
-            // write to shell
-            write(STDERR_FILENO, pid, length);
-        }
-        curr = curr->next;
-    }
-
-    queue *low = s->low;
-    curr = queueFront(low);
-    while (curr != NULL) {
-        if (curr->pcb->status == READY) {
-
-            /// build output string with pid, ppid, and priority
-            char pid[20];
-            sprintf(pid, "%d ", curr->pcb->pid);
-
-            char ppid[20];
-            sprintf(ppid, "%d ", curr->pcb->ppid);
-
-            char priority[20];
-            sprintf(priority, "%d\n", curr->pcb->priority_level);
-
-            strcat(ppid, priority);
-            strcat(pid, ppid);
-            int length = strlen(pid);
-
-            // write to shell
-            write(STDERR_FILENO, pid, length);
+                    // write to shell
+                    f_write(STDOUT_FILENO, (uint8_t *) line, strlen(line));
+                }
+                curr = curr->next;
+            }
         }
-        curr = curr->next;
     }
 }
 
@@ -265,13 +246,13 @@ void cat(char **argv) {
 
         int bytesRead = 0;
 
-        while ((bytesRead = f_read(getCurrProcess()->stdin, bufSize, buf)) != 0) {
+        while ((bytesRead = f_read(STDIN_FILENO, bufSize, buf)) != 0) {
             if (bytesRead == -1) {
                 printf("Failed to read from stdin\n");
                 return;
             }
 
-            if (f_write(getCurrProcess()->stdout, buf, bytesRead) == FAILURE)
+            if (f_write(STDOUT_FILENO, buf, bytesRead) == FAILURE)
                 return;
         }
 
@@ -297,7 +278,7 @@ void cat(char **argv) {
             }
 
             // write the buffer to STDOUT
-            if (f_write(getCurrProcess()->stdout, buf, bytesRead) == FAILURE)
+            if (f_write(STDOUT_FILENO, buf, bytesRead) == FAILURE)
                 return;
         }
 
@@ -312,12 +293,57 @@ void ls() {
     f_ls();
 }
 
+void cachestat() {
+    KERNEL_ENTER;
+    blockCache *cache = mountedFat->cache;
+
+    if (cache == NULL) {
+        printf("Block cache disabled\n");
+        return;
+    }
+
+    printf("Slots used: %d/%d\n", cache->used, cache->capacity);
+    printf("Hits: %llu\n", (unsigned long long) cache->hits);
+    printf("Misses: %llu\n", (unsigned long long) cache->misses);
+    printf("Writebacks: %llu\n", (unsigned long long) cache->writebacks);
+}
+
+void quantum(char **argv) {
+    // print the current quantum if no new one is given
+    if (argv[1] == NULL) {
+        printf("Quantum: %d ms\n", getQuantum());
+        return;
+    }
+
+    if (setQuantum(atoi(argv[1])) == FAILURE) {
+        printf("quantum: must be between %d and %d ms\n", MIN_QUANTUM, MAX_QUANTUM);
+    }
+}
+
+void allocstat() {
+    printf("Kernel allocations: %d\n", getKernelAllocs());
+    printf("Last tick: %d\n", getTickAllocs());
+}
+
+void sched(char **argv) {
+    // print the current policy if no new one is given
+    if (argv[1] == NULL) {
+        printf("Policy: %s\n", getSchedulingPolicy());
+        return;
+    }
+
+    if (setSchedulingPolicy(argv[1]) == FAILURE) {
+        printf("sched: policy must be priority or stride\n");
+    }
+}
+
 void list_fds() {
-    fdNode *node = container->firstFdNode;
+    pcb_t *process = getCurrProcess();
 
-    while (node != NULL) {
-        printf("File %s at fdno %d in mode %d at pos %d\n", node->entry->name, node->id, node->mode, node->pos);
-        node = node->next;
+    for (int fd = 0; fd < FD_TABLE_SIZE; fd++) {
+        fdNode *node = process->fds[fd];
+        if (node != NULL && node->entry != NULL)
+            printf("File %s at fdno %d in mode %d at pos %d\n", node->entry->name, fd, node->mode, node->pos);
     }
 }
 
@@ -367,10 +393,13 @@ void cp(char **argv) {
     if (src_fd == FAILURE)
         return;
 
-    int size = f_lseek(src_fd, 0, SEEK_END);
+    int size = f_lseek(src_fd, 0, F_SEEK_END);
 
-    if (size == FAILURE)
+    // rewind so the whole file is read in a single f_read
+    if (size == FAILURE || f_lseek(src_fd, 0, F_SEEK_SET) == FAILURE) {
+        f_close(src_fd);
         return;
+    }
 
     // get bytes of src file
     uint8_t *buf = malloc(sizeof(uint8_t) * size);
@@ -458,6 +487,47 @@ void destroyQueueAndExit(jobQueue *jobQueue, int exitVal) {
 
 pid_t currentPgId = -1;
 
+/**
+ * @brief      Reads one line of input through the kernel's terminal buffer, like getline
+ *
+ * @param      line  Set to a malloced buffer holding the line
+ *
+ * @return     The length of the line, or -1 at the end of input or if it failed
+ */
+ssize_t readLine(char **line) {
+    size_t capacity = 128;
+    size_t len = 0;
+    char *buf = malloc(capacity);
+    if (buf == NULL) {
+        p_errno = p_ENOMEM;
+        return -1;
+    }
+
+    // each read returns at most one line, so stop once it ends in a newline
+    while (len == 0 || buf[len - 1] != '\n') {
+        if (len + 1 == capacity) {
+            char *bigger = realloc(buf, capacity * 2);
+            if (bigger == NULL) {
+                free(buf);
+                p_errno = p_ENOMEM;
+                return -1;
+            }
+            buf = bigger;
+            capacity *= 2;
+        }
+
+        int bytesRead = f_read(STDIN_FILENO, capacity - len - 1, (uint8_t *) &buf[len]);
+        if (bytesRead <= 0) {
+            break;
+        }
+        len += bytesRead;
+    }
+
+    buf[len] = '\0';
+    *line = buf;
+    return len == 0 ? -1 : len;
+}
+
 void shell() {
 
     // initialize job queue
@@ -484,14 +554,13 @@ void shell() {
         }
 
         char *line = NULL;
-        size_t len = 0;
         ssize_t n = 0;
 
          // reset errno
         RESET_ERRNO
 
         checkForTerminalControl();
-        n = getline(&line, &len, stdin);
+        n = readLine(&line);
         // handle errors in reading the user input
         if (n == -1) {   
             if (line != NULL) {
@@ -28,7 +28,7 @@ void busy();
 /**
  * @brief Function for printing first ten lines of specified files to console
  * 
- * @param argv list of files to call head on
+ * @param argv list of files to call head on, stdin is read if there are none
  */
 void head(char **argv);
 
@@ -67,6 +67,30 @@ void createSleep(char **argv);
  */
 void ls();
 
+/**
+ * @brief      Prints the hit, miss and writeback counters of the mounted filesystem's block cache
+ */
+void cachestat();
+
+/**
+ * @brief      Prints the clock tick length, or changes it when given a new length in milliseconds
+ *
+ * @param      argv  The command arguments
+ */
+void quantum(char **argv);
+
+/**
+ * @brief      Prints the scheduling policy, or switches every CPU to the named one
+ *
+ * @param      argv  The command arguments
+ */
+void sched(char **argv);
+
+/**
+ * @brief      Prints how many allocations the kernel has made, in total and during the last tick
+ */
+void allocstat();
+
 /**
  * @brief      Creates empty files if they do not exist or update timestamp otherwise
  *
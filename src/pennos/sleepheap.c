@@ -0,0 +1,118 @@
+#include <stdlib.h>
+
+#include "sleepheap.h"
+#include "../include/macros.h"
+
+/**
+ * @brief      Stores a process at a heap position and records the position in its pcb
+ *
+ * @param      heap     The sleep heap
+ * @param      index    The heap position
+ * @param      process  The process
+ */
+void setHeapItem(sleepHeap *heap, int index, pcb_t *process) {
+    heap->items[index] = process;
+    process->sleepIndex = index;
+}
+
+/**
+ * @brief      Moves the process at a position up until its parent wakes no later
+ *
+ * @param      heap   The sleep heap
+ * @param      index  The heap position
+ */
+void siftUp(sleepHeap *heap, int index) {
+    pcb_t *process = heap->items[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (heap->items[parent]->wakeTick <= process->wakeTick) {
+            break;
+        }
+        setHeapItem(heap, index, heap->items[parent]);
+        index = parent;
+    }
+    setHeapItem(heap, index, process);
+}
+
+/**
+ * @brief      Moves the process at a position down until its children wake no earlier
+ *
+ * @param      heap   The sleep heap
+ * @param      index  The heap position
+ */
+void siftDown(sleepHeap *heap, int index) {
+    pcb_t *process = heap->items[index];
+    while (true) {
+        int child = 2 * index + 1;
+        if (child >= heap->count) {
+            break;
+        }
+        if (child + 1 < heap->count && heap->items[child + 1]->wakeTick < heap->items[child]->wakeTick) {
+            child++;
+        }
+        if (process->wakeTick <= heap->items[child]->wakeTick) {
+            break;
+        }
+        setHeapItem(heap, index, heap->items[child]);
+        index = child;
+    }
+    setHeapItem(heap, index, process);
+}
+
+sleepHeap *sleepHeapInit() {
+    // allocate memory for this heap
+    sleepHeap *heap = malloc(sizeof(sleepHeap));
+    if (heap == NULL) {
+        return NULL;
+    }
+
+    heap->items = malloc(SLEEP_HEAP_MIN_SIZE * sizeof(pcb_t *));
+    if (heap->items == NULL) {
+        free(heap);
+        return NULL;
+    }
+    heap->count = 0;
+    heap->capacity = SLEEP_HEAP_MIN_SIZE;
+    return heap;
+}
+
+int sleepHeapPush(sleepHeap *heap, pcb_t *process) {
+    // grow the heap array only when it is full
+    if (heap->count == heap->capacity) {
+        pcb_t **items = realloc(heap->items, heap->capacity * 2 * sizeof(pcb_t *));
+        if (items == NULL) {
+            return -1;
+        }
+        heap->items = items;
+        heap->capacity *= 2;
+    }
+
+    setHeapItem(heap, heap->count, process);
+    heap->count++;
+    siftUp(heap, heap->count - 1);
+    return 0;
+}
+
+pcb_t *sleepHeapPeek(sleepHeap *heap) {
+    if (heap->count == 0) {
+        return NULL;
+    }
+    return heap->items[0];
+}
+
+void sleepHeapRemove(sleepHeap *heap, pcb_t *process) {
+    int index = process->sleepIndex;
+    if (index < 0 || index >= heap->count || heap->items[index] != process) {
+        return;
+    }
+
+    // fill the hole with the last sleeper and restore the heap order around it
+    heap->count--;
+    process->sleepIndex = -1;
+    if (index == heap->count) {
+        return;
+    }
+    setHeapItem(heap, index, heap->items[heap->count]);
+    siftUp(heap, index);
+    siftDown(heap, heap->items[index]->sleepIndex);
+}
@@ -0,0 +1,50 @@
+#ifndef SLEEPHEAP_HEADER
+#define SLEEPHEAP_HEADER
+
+#include "PCB.h"
+
+/**
+ * @file sleepheap.h
+ * @brief Defines a min-heap of sleeping processes ordered by absolute wake tick
+ */
+
+/**
+ * A binary min-heap of sleeping processes keyed on pcb->wakeTick. Each process
+ * records its position in pcb->sleepIndex (-1 when not in the heap), so a sleeper
+ * can be removed in O(log n) when it is stopped or killed.
+ */
+typedef struct {
+    pcb_t **items; // The heap array
+    int count; // The number of sleeping processes
+    int capacity; // The allocated length of items
+} sleepHeap;
+
+/**
+ * Allocates and initializes an empty sleep heap
+ * @return a pointer to the new heap, or NULL if failed to allocate memory
+ */
+sleepHeap *sleepHeapInit();
+
+/**
+ * Adds a process to the heap using its wakeTick
+ * @param heap the sleep heap
+ * @param process the process to add, which must not already be in the heap
+ * @return 0 on success, -1 if the heap failed to grow
+ */
+int sleepHeapPush(sleepHeap *heap, pcb_t *process);
+
+/**
+ * Gets the process with the earliest wake tick without removing it
+ * @param heap the sleep heap
+ * @return the earliest sleeper, or NULL if the heap is empty
+ */
+pcb_t *sleepHeapPeek(sleepHeap *heap);
+
+/**
+ * Removes a process from the heap. Does nothing if it is not in the heap
+ * @param heap the sleep heap
+ * @param process the process to remove
+ */
+void sleepHeapRemove(sleepHeap *heap, pcb_t *process);
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "stackpool.h"
+#include "../include/macros.h"
+
+/**
+ * A released stack, linked through its own (unused) memory
+ */
+typedef struct freeStackTag {
+    struct freeStackTag *next;
+    size_t size; // The usable size of this stack
+} freeStack;
+
+// the released stacks waiting to be reused
+freeStack *freeStacks = NULL;
+
+// the number of released stacks in the pool
+int freeStackCount = 0;
+
+// the host page size, which is also the guard size
+size_t pageSize = 0;
+
+/**
+ * @brief      Gets the page size of the host
+ *
+ * @return     The page size in bytes
+ */
+size_t getPageSize() {
+    if (pageSize == 0) {
+        pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    }
+    return pageSize;
+}
+
+int stackPoolAlloc(stack_t *stack, size_t size) {
+    size_t page = getPageSize();
+    if (size == 0) {
+        size = STACK_SIZE;
+    }
+    size = (size + page - 1) / page * page;
+
+    // reuse a released stack of the same size
+    freeStack **link = &freeStacks;
+    while (*link != NULL) {
+        freeStack *s = *link;
+        if (s->size == size) {
+            *link = s->next;
+            freeStackCount--;
+            *stack = (stack_t) { .ss_sp = s, .ss_size = size };
+            return 0;
+        }
+        link = &s->next;
+    }
+
+    // map a new stack with a guard page below it
+    uint8_t *base = mmap(NULL, size + page, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    if (mprotect(base, page, PROT_NONE) == -1) {
+        munmap(base, size + page);
+        return -1;
+    }
+
+    *stack = (stack_t) { .ss_sp = base + page, .ss_size = size };
+    return 0;
+}
+
+void stackPoolRelease(stack_t *stack) {
+    if (stack->ss_sp == NULL) {
+        return;
+    }
+
+    if (freeStackCount < STACK_POOL_SIZE) {
+        freeStack *s = stack->ss_sp;
+        s->size = stack->ss_size;
+        s->next = freeStacks;
+        freeStacks = s;
+        freeStackCount++;
+    } else {
+        size_t page = getPageSize();
+        munmap((uint8_t *) stack->ss_sp - page, stack->ss_size + page);
+    }
+
+    *stack = (stack_t) { .ss_sp = NULL, .ss_size = 0 };
+}
+
+bool stackPoolIsGuard(stack_t *stack, void *addr) {
+    if (stack->ss_sp == NULL) {
+        return false;
+    }
+    uint8_t *top = stack->ss_sp;
+    return (uint8_t *) addr < top && (uint8_t *) addr >= top - getPageSize();
+}
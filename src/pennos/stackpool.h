@@ -0,0 +1,39 @@
+#ifndef STACKPOOL_HEADER
+#define STACKPOOL_HEADER
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @file stackpool.h
+ * @brief Hands out mmap'd process stacks with a guard page and recycles them
+ */
+
+/**
+ * Gives a context a stack of at least size bytes, rounded up to whole pages. The
+ * page below the stack is mapped PROT_NONE, so running off the end of the stack
+ * faults instead of corrupting other memory. A released stack of the same size
+ * is reused when there is one
+ * @param stack pointer to the stack_t to fill in
+ * @param size the usable stack size in bytes, or 0 for STACK_SIZE
+ * @return 0 on success, or -1 if mapping a new stack failed
+ */
+int stackPoolAlloc(stack_t *stack, size_t size);
+
+/**
+ * Returns a stack from stackPoolAlloc to the pool, unmapping it if the pool is
+ * full. Does nothing for an empty stack_t
+ * @param stack pointer to the stack_t to release, which is cleared
+ */
+void stackPoolRelease(stack_t *stack);
+
+/**
+ * Checks whether an address lies in the guard page below a pooled stack
+ * @param stack the stack to check
+ * @param addr the faulting address
+ * @return true if addr is in the guard page of stack
+ */
+bool stackPoolIsGuard(stack_t *stack, void *addr);
+
+#endif
@@ -0,0 +1,58 @@
+#include <poll.h>
+#include <unistd.h>
+
+#include "terminal.h"
+
+void terminalInit(terminal *t) {
+    t->head = 0;
+    t->count = 0;
+    t->eof = false;
+    t->readers = (queue) { .count = 0, .front = NULL, .back = NULL };
+}
+
+int terminalFill(terminal *t, int fd) {
+    int added = 0;
+    struct pollfd host = { .fd = fd, .events = POLLIN };
+
+    // read only what the host already has, a zero timeout never blocks
+    while (!t->eof && t->count < TERMINAL_BUFFER_SIZE && poll(&host, 1, 0) > 0) {
+        if (host.revents & (POLLERR | POLLNVAL)) {
+            t->eof = true;
+            break;
+        }
+
+        // fill the free space up to the end of the ring, the next pass wraps around
+        int tail = (t->head + t->count) % TERMINAL_BUFFER_SIZE;
+        int space = tail >= t->head ? TERMINAL_BUFFER_SIZE - tail : t->head - tail;
+        ssize_t bytesRead = read(fd, &t->data[tail], space);
+        if (bytesRead == 0) {
+            t->eof = true;
+        } else if (bytesRead < 0) {
+            break;
+        } else {
+            t->count += bytesRead;
+            added += bytesRead;
+        }
+    }
+    return added;
+}
+
+bool terminalHasInput(terminal *t) {
+    return t->count > 0 || t->eof;
+}
+
+int terminalTake(terminal *t, uint8_t *buf, int n) {
+    int taken = 0;
+    while (taken < n && t->count > 0) {
+        uint8_t c = t->data[t->head];
+        buf[taken++] = c;
+        t->head = (t->head + 1) % TERMINAL_BUFFER_SIZE;
+        t->count--;
+
+        // a read returns at most one line
+        if (c == '\n') {
+            break;
+        }
+    }
+    return taken;
+}
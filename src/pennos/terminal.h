@@ -0,0 +1,58 @@
+#ifndef TERMINAL_HEADER
+#define TERMINAL_HEADER
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "queue.h"
+#include "../include/macros.h"
+
+/**
+ * @file terminal.h
+ * @brief Defines the kernel's terminal input buffer and its line discipline
+ */
+
+/**
+ * A ring buffer of terminal input owned by the kernel. It is filled with
+ * non-blocking reads of the host terminal, so no process ever waits inside the
+ * host, and is read one line at a time. Processes waiting for input are BLOCKED
+ * on readers until the kernel sees some arrive.
+ */
+typedef struct {
+    uint8_t data[TERMINAL_BUFFER_SIZE]; // The buffered input
+    int head; // The position of the first unread byte in data
+    int count; // The number of unread bytes
+    bool eof; // Whether the host terminal has reached the end of input
+    queue readers; // The processes waiting for input, linked through their waitNode
+} terminal;
+
+/**
+ * Initializes an empty terminal buffer with no readers
+ * @param t the terminal buffer
+ */
+void terminalInit(terminal *t);
+
+/**
+ * Moves whatever input the host has ready into the buffer, without blocking
+ * @param t the terminal buffer
+ * @param fd the host file descriptor to read
+ * @return the number of bytes added
+ */
+int terminalFill(terminal *t, int fd);
+
+/**
+ * Checks whether a read of the terminal would return right away
+ * @param t the terminal buffer
+ * @return true if there is buffered input or the input has ended
+ */
+bool terminalHasInput(terminal *t);
+
+/**
+ * Takes up to n bytes of buffered input, stopping after the first newline
+ * @param t the terminal buffer
+ * @param buf the buffer to copy the input into
+ * @param n the most bytes to take
+ * @return the number of bytes taken, 0 at the end of input
+ */
+int terminalTake(terminal *t, uint8_t *buf, int n);
+
+#endif
@@ -4,21 +4,23 @@
 #include <string.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 #include "kernel.h"
 #include "node.h"
 #include "PCB.h"
 #include "signal.h"
+#include "filedescriptor.h"
 #include "../include/macros.h"
 
 void setForegroundProcess (pid_t pid) {
+	KERNEL_ENTER;
 	setForeground(pid);
 }
 
 int p_nice(pid_t pid, int priority) {
+    KERNEL_ENTER;
 
-    scheduler *s = getScheduler();
-    queue *processTable = getProcessTable();
-    node *process = queueSearch(processTable, newNode(pid, NULL));
+    node *process = findProcess(pid);
 
     if (process == NULL) {
         return -1;
@@ -26,30 +28,30 @@ int p_nice(pid_t pid, int priority) {
 
     int prev = process->pcb->priority_level;
     pcb_t *pcb = process->pcb;
-    if (prev == -1) {
-        process = queueSearch(s->high, process);
-    } else if (prev == 0) {
-        process = queueSearch(s->med, process);
-    } else {
-        process = queueSearch(s->low, process);
-    }
-    removeFromScheduler(process, s);
-    pcb->priority_level = priority;
-    addToScheduler(newNode(pid, pcb), s);
+    setSchedulerPriority(pcb, priority, getScheduler(pcb->cpu));
 
     fprintf(getLogfile(), "[%d] NICE %d %d %d %s\n", getNumTicks(), pid, prev, priority, pcb->name);
 
     return 0;
 }
 
-pid_t p_spawn(void (*func)(), char*argv[], int fd0, int fd1) {
+pid_t p_spawn_stack(void (*func)(), char*argv[], int fd0, int fd1, size_t stackSize) {
+	KERNEL_ENTER;
 	FILE *logFile = getLogfile();
+	pcb_t *parent = getCurrProcess();
+
+	// the child starts with the parent's fd0 and fd1 as its stdin and stdout
+	fdNode *in = fdLookup(parent, fd0);
+	fdNode *out = fdLookup(parent, fd1);
+	if (in == NULL || out == NULL) {
+		p_errno = p_EINVAL;
+		return FAILURE;
+	}
+
 	// create child process
-	pcb_t *child = k_process_create(getCurrProcess());
-	child->stdin = fd0;
-	child->stdout = fd1;
+	pcb_t *child = k_process_create(parent);
 	
-	child->name = malloc(sizeof(char) * (strlen(argv[0]) + 1));
+	child->name = kernelAlloc(sizeof(char) * (strlen(argv[0]) + 1));
 	strcpy(child->name, argv[0]);
 
 	// check for errors
@@ -57,14 +59,130 @@ pid_t p_spawn(void (*func)(), char*argv[], int fd0, int fd1) {
 		return FAILURE;
 	}
 
+	// the child shares the open files, which stay open until it ends whenever the parent closes them
+	fdSet(child, STDIN_FILENO, in);
+	fdSet(child, STDOUT_FILENO, out);
+
 	// update the context for the child process
-	makeContext(&(child->context), func, argv);
+	makeProcessContext(child, func, argv, stackSize);
 
 	fprintf(logFile, "[%d] CREATED %d %d %s\n", getNumTicks(), child->pid, child->priority_level, child->name);
 	return child->pid;
 }
 
+pid_t p_spawn(void (*func)(), char*argv[], int fd0, int fd1) {
+	return p_spawn_stack(func, argv, fd0, fd1, 0);
+}
+
+int p_pipe(int fds[2]) {
+	KERNEL_ENTER;
+	pcb_t *process = getCurrProcess();
+	pipeBuffer *pipe = newPipe();
+	if (pipe == NULL) {
+		p_errno = p_ENOMEM;
+		return FAILURE;
+	}
+
+	// each end holds the pipe open until it is released, so a failure releases what was made
+	fdNode *readEnd = newPipeDescriptorNode(pipe, F_READ);
+	fdNode *writeEnd = newPipeDescriptorNode(pipe, F_WRITE);
+	if (readEnd == NULL || writeEnd == NULL) {
+		if (readEnd != NULL) {
+			fdRelease(readEnd);
+		} else {
+			pipeClose(pipe, false);
+		}
+		if (writeEnd != NULL) {
+			fdRelease(writeEnd);
+		} else {
+			pipeClose(pipe, true);
+		}
+		p_errno = p_ENOMEM;
+		return FAILURE;
+	}
+
+	fds[0] = fdInstall(process, readEnd);
+	if (fds[0] == FAILURE) {
+		fdRelease(readEnd);
+		fdRelease(writeEnd);
+		p_errno = p_EINVAL;
+		return FAILURE;
+	}
+
+	fds[1] = fdInstall(process, writeEnd);
+	if (fds[1] == FAILURE) {
+		process->fds[fds[0]] = NULL;
+		fdRelease(readEnd);
+		fdRelease(writeEnd);
+		p_errno = p_EINVAL;
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+int p_dup2(int oldfd, int newfd) {
+	KERNEL_ENTER;
+	pcb_t *process = getCurrProcess();
+	fdNode *file = fdLookup(process, oldfd);
+	if (file == NULL || newfd < 0 || newfd >= FD_TABLE_SIZE) {
+		p_errno = p_EINVAL;
+		return FAILURE;
+	}
+
+	// newfd now shares oldfd's open file, closing what it referred to before
+	if (oldfd != newfd) {
+		fdSet(process, newfd, file);
+	}
+	return newfd;
+}
+
+/*
+ * Helper function for taking the event a child posted for p_waitpid, reaping the
+ * child if it has exited
+ * @param child, pointer to the child whose event is taken
+ * @param wstatus, set to the status the child posted
+ * @return the pid of the child
+ */
+pid_t takeChildEvent(pcb_t *child, int *wstatus) {
+	FILE *logFile = getLogfile();
+	pid_t pid = child->pid;
+	*wstatus = child->eventStatus;
+	withdrawChildEvent(child);
+
+	if (!child->waitedOn) {
+		fprintf(logFile, "[%d] WAITED %d %d %s\n", getNumTicks(), child->pid, child->priority_level, child->name);
+		child->waitedOn = true;
+	}
+
+	// unblock parent only if in foreground
+	pcb_t *foregroundProcess = getForegroundProcess();
+	if (pid == foregroundProcess->pid) {
+		unblockParent(child->ppid);
+	}
+
+	// an exited child is a zombie until now, so remove it. Its children are reaped
+	// first, since cleaning it up recycles its PCB
+	if (W_WIFEXITED(*wstatus) || W_WIFSIGNALED(*wstatus)) {
+		clearZombiesAndChildren(child);
+		k_process_cleanup(child);
+	}
+	return pid;
+}
+
+/*
+ * Helper function for keeping the clock from preempting between checking for a child
+ * event and waiting for one, or the child could post it in between and wake nobody
+ * @param old, set to the signal mask to restore afterwards
+ */
+void blockClock(sigset_t *old) {
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGALRM);
+	sigprocmask(SIG_BLOCK, &mask, old);
+}
+
 pid_t p_waitpid(pid_t pid, int*wstatus, bool nohang) {
+	KERNEL_ENTER;
 	FILE *logFile = getLogfile();
 
 	// check for errors
@@ -73,199 +191,76 @@ pid_t p_waitpid(pid_t pid, int*wstatus, bool nohang) {
 		return FAILURE;
 	}
 
-	queue *processTable = getProcessTable();
 	pcb_t *parent = getCurrProcess();
 
-
 	// check for errors
-	if (processTable == NULL || parent == NULL) {
+	if (parent == NULL) {
 		p_errno = -2;
 		return FAILURE;
 	}
 
+	sigset_t old;
 	if (pid > 0) {
-		node *childNode = queueSearch(processTable, newNode(pid, NULL));
+		node *childNode = findProcess(pid);
 
 		// check for errors
-		if (childNode == NULL) {
+		if (childNode == NULL || childNode->pcb->ppid != parent->pid) {
 			p_errno = -1;
 			return FAILURE;
 		}
 
-		if (!childNode->pcb->waitedOn) {
-			fprintf(logFile, "[%d] WAITED %d %d %s\n", getNumTicks(), childNode->pid, childNode->pcb->priority_level, childNode->pcb->name);
-			childNode->pcb->waitedOn = true;
+		pcb_t *child = childNode->pcb;
+		if (!child->waitedOn) {
+			fprintf(logFile, "[%d] WAITED %d %d %s\n", getNumTicks(), child->pid, child->priority_level, child->name);
+			child->waitedOn = true;
 		}
 
-		//check if the child is a zombie
-		child *currZombie = parent->zombies;
-		while (currZombie != NULL) {
-			// if child is zombie remove it
-			if (currZombie->pid == pid) {
-				// remove node from process table
-				node *nodeToRemove = queueSearch(processTable, newNode(currZombie->pid, NULL));
-				k_process_cleanup(nodeToRemove->pcb);
-				clearZombiesAndChildren(nodeToRemove->pcb);
-				*wstatus = childNode->pcb->status;
-				return pid;
-			}
-			currZombie = currZombie->next;
+		// check if the child has stopped or exited already
+		if (child->eventPosted) {
+			return takeChildEvent(child, wstatus);
 		}
 
 		if (nohang) {
-			// check if there was a status change
-			if (childNode->pcb->prevStatus != -1 && (childNode->pcb->prevStatus != childNode->pcb->status)) {
-				childNode->pcb->prevStatus = childNode->pcb->status;
-				*wstatus = childNode->pcb->status;
-
-				// unblock parent only if in foreground
-				pcb_t *foregroundProcess = getForegroundProcess();
-				if (childNode->pid == foregroundProcess->pid) {
-					unblockParent(childNode->pcb->ppid);
-				}
-				return pid;
-			}
 			return 0;
-		} else {
-			// check if there was a status change
-			if (childNode->pcb->prevStatus != -1 && (childNode->pcb->prevStatus != childNode->pcb->status)) {
-				childNode->pcb->prevStatus = childNode->pcb->status;
-				*wstatus = childNode->pcb->status;
-				
-				// unblock parent only if in foreground
-				pcb_t *foregroundProcess = getForegroundProcess();
-				if (childNode->pid == foregroundProcess->pid) {
-					unblockParent(childNode->pcb->ppid);
-				}
-				return pid;
-			}
-			childNode->pcb->prevStatus = childNode->pcb->status;
-			setForegroundProcess(pid);
-
-			// perform a context switch
-			switchContext(0);
-
-			// check if there was a status change
-			if (childNode->pcb->prevStatus != childNode->pcb->status) {
-				childNode->pcb->prevStatus = childNode->pcb->status;
-				*wstatus = childNode->pcb->status;
-				
-				// unblock parent only if in foreground
-				pcb_t *foregroundProcess = getForegroundProcess();
-				if (childNode->pid == foregroundProcess->pid) {
-					unblockParent(childNode->pcb->ppid);
-				}
-			}
-			return pid;
 		}
-	} else {
-		//check for zombie children
-		child *currZombie = parent->zombies;
-
-		if (currZombie != NULL) {
-			// remove zombie child
-			parent->zombies = parent->zombies->next;
-			if (parent->zombies != NULL) {
-				parent->zombies->prev = NULL;
-			}
-
-			// update wstatus and clean up zombie child
-			node *childToRemove = queueSearch(processTable, newNode(currZombie->pid, NULL));
-
-			// check for errors
-			if (childToRemove == NULL) {
-				p_errno = -1;
-				return FAILURE;
-			}
-			*wstatus = childToRemove->pcb->status;
-			k_process_cleanup(childToRemove->pcb);
 
-			// unblock parent only if in foreground
-			pcb_t *foregroundProcess = getForegroundProcess();
-			if (childToRemove->pid == foregroundProcess->pid) {
-				unblockParent(childToRemove->pcb->ppid);
-			}
-			if (!childToRemove->pcb->waitedOn) {
-				fprintf(logFile, "[%d] WAITED %d %d %s\n", getNumTicks(), childToRemove->pid, childToRemove->pcb->priority_level, childToRemove->pcb->name);
-				childToRemove->pcb->waitedOn = true;
-			}
-			return childToRemove->pid;
+		// hand the child the terminal and block until it posts an event. Events
+		// of other children wake the parent too, so it checks again every time
+		setForegroundProcess(pid);
+		blockClock(&old);
+		while (!child->eventPosted) {
+			waitOn(&parent->childWait);
 		}
-
-		// loop through non-zombie children
-		child *head = parent->child_pids;
-
-		while (head != NULL) {
-			node *childNode = queueSearch(processTable, newNode(head->pid, NULL));
-			if (!childNode->pcb->waitedOn) {
-				fprintf(logFile, "[%d] WAITED %d %d %s\n", getNumTicks(), childNode->pid, childNode->pcb->priority_level, childNode->pcb->name);
-				childNode->pcb->waitedOn = true;
-			}
-			//check if the status of any child has changed
-			if (childNode->pcb->prevStatus != -1 && (childNode->pcb->prevStatus != childNode->pcb->status)) {
-				childNode->pcb->prevStatus = childNode->pcb->status;
-				*wstatus = childNode->pcb->status;
-				pcb_t *foregroundProcess = getForegroundProcess();
-				if (childNode->pid == foregroundProcess->pid) {
-					unblockParent(childNode->pcb->ppid);
-				}
-				return childNode->pid;
-			}
-			// recursively check children and grandchildren
-			pid_t res = traverseChild(childNode->pcb, wstatus);
-			if (res != 0) {
-				return res;
-			}
-			head = head->next;
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		return takeChildEvent(child, wstatus);
+	} else {
+		// the oldest event of any child is taken first
+		if (parent->childEvents.front != NULL) {
+			return takeChildEvent(parent->childEvents.front->pcb, wstatus);
 		}
 
 		if (nohang) {	
 			return 0;
-		} else {
-			// block parent
-            parent->status = BLOCKED;
-            fprintf(logFile, "[%d] BLOCKED %d %d %s\n", getNumTicks(), parent->pid, parent->priority_level, parent->name);
-
-			// perform a context switch
-			switchContext(0);
-
-			// loop through non-zombie children
-			child *head = parent->child_pids;
-			while (head != NULL) {
-				node *childNode = queueSearch(processTable, newNode(head->pid, NULL));
-				if (!childNode->pcb->waitedOn) {
-					fprintf(logFile, "[%d] WAITED %d %d %s\n", getNumTicks(), childNode->pid, childNode->pcb->priority_level, childNode->pcb->name);
-					childNode->pcb->waitedOn = true;
-				}	
-				//check if the status of any child has changed
-				if (childNode->pcb->prevStatus != -1 && (childNode->pcb->prevStatus != childNode->pcb->status)) {
-					childNode->pcb->prevStatus = childNode->pcb->status;
-					*wstatus = childNode->pcb->status;
-
-					// unblock parent only if in foreground
-					pcb_t *foregroundProcess = getForegroundProcess();
-					if (childNode->pid == foregroundProcess->pid) {
-						unblockParent(childNode->pcb->ppid);
-					}
-					return childNode->pid;
-				}
-				// recursively check children and grandchildren
-				pid_t res = traverseChild(childNode->pcb, wstatus);
-				if (res != 0) {
-					return res;
-				}
-
-				head = head->next;
-			}
+		}
 
-			return 0;
+		// block until some child posts an event
+		blockClock(&old);
+		while (parent->childEvents.front == NULL) {
+			if (parent->children.count == 0) {
+				sigprocmask(SIG_SETMASK, &old, NULL);
+				p_errno = -1;
+				return FAILURE;
+			}
+			waitOn(&parent->childWait);
 		}
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		return takeChildEvent(parent->childEvents.front->pcb, wstatus);
 	}
 }
 
 int p_kill(pid_t pid, int sig) {
-	queue *processTable = getProcessTable();
-	node *n = queueSearch(processTable, newNode(pid, NULL));
+	KERNEL_ENTER;
+	node *n = findProcess(pid);
 	
 	if (n == NULL) {
 		p_errno = -1;
@@ -277,6 +272,7 @@ int p_kill(pid_t pid, int sig) {
 }
 
 void p_exit(void) {
+	KERNEL_ENTER;
 	pcb_t *currProcess = getCurrProcess();
 
 	// check for errors
@@ -291,12 +287,13 @@ void p_exit(void) {
 	}
 
 	// update status
-    currProcess->status = EXITED;
+    setProcessStatus(currProcess, EXITED);
     dealWithUnwaitedProcess(currProcess);
     switchContext(0);
 }
 
 void checkForTerminalControl() {
+	KERNEL_ENTER;
 	// get currently running process and foreground process
 	pcb_t *curr = getCurrProcess();
 	pcb_t *foregroundProcess = getForegroundProcess();
@@ -311,6 +308,7 @@ void checkForTerminalControl() {
 }
 
 void p_sleep(unsigned int ticks) {
+	KERNEL_ENTER;
 	// block current process
 	pcb_t *currProcess = getCurrProcess();
 	if (currProcess == NULL) {
@@ -318,7 +316,11 @@ void p_sleep(unsigned int ticks) {
         p_exit();
     }
 
-	currProcess->status = BLOCKED;
+	setProcessStatus(currProcess, BLOCKED);
 	currProcess->ticksLeft = ticks;
-	addToAsleep(newNode(currProcess->pid, currProcess));
+
+	// an indefinite sleep (negative ticks) is never woken
+	if (currProcess->ticksLeft >= 0) {
+		addToAsleep(currProcess);
+	}
 }
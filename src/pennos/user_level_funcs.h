@@ -6,16 +6,49 @@
 /*
  * User level function for forking a new thread that retains most of the attributes of the parent thread. 
  * Once the thread is spawned, it executes the function referenced by func with its argument array argv. 
+ * The child gets its own descriptor table, with the caller's fd0 as its stdin and fd1 as its stdout
  * @param func pointer to function to be run by the new child process
  * @param argv array of parameters for func
+ * @param fd0 the caller's file descriptor to use as the child's stdin
+ * @param fd1 the caller's file descriptor to use as the child's stdout
  * @return the pid of the child thread on success, or -1 on error
  */
 pid_t p_spawn(void (*func)(), char*argv[], int fd0, int fd1);
 
+/*
+ * User level function for spawning a thread like p_spawn, but with a stack of the given size
+ * @param func pointer to function to be run by the new child process
+ * @param argv array of parameters for func
+ * @param stackSize the stack size in bytes, or 0 for the default
+ * @return the pid of the child thread on success, or -1 on error
+ */
+pid_t p_spawn_stack(void (*func)(), char*argv[], int fd0, int fd1, size_t stackSize);
+
+/*
+ * User level function for creating a pipe, a fixed-size kernel buffer read through one
+ * descriptor and written through the other. Reading an empty pipe blocks until data is
+ * written, and returns 0 once every write end is closed. Writing a full pipe blocks until
+ * data is read, and fails once every read end is closed
+ * @param fds set to the read end in fds[0] and the write end in fds[1]
+ * @return 0 on success, or -1 on error
+ */
+int p_pipe(int fds[2]);
+
+/*
+ * User level function for making newfd refer to the same open file as oldfd, closing what
+ * newfd referred to before. The two descriptors share the file's position
+ * @param oldfd the open file descriptor to duplicate
+ * @param newfd the file descriptor to replace, which need not be open
+ * @return newfd on success, or -1 on error
+ */
+int p_dup2(int oldfd, int newfd);
+
 /*
  * User level function for setting the calling thread as blocked (ifnohangis false) until a child of the
  * calling thread changes state. If nohang is true, p_waitpid does not block but returns immediately.
- * @param pid the pid of the child to wait on
+ * Children post their stops and exits to the parent, so each call takes one posted event in O(1)
+ * and reaps the child if it has exited
+ * @param pid the pid of the child to wait on, or -1 for the child whose event was posted first
  * @param wstatus a pointer to be updated to the stats of the child
  * @param nohang whether this is a blocking wait or not
  * @return the pid of the child which has changed state on success, or -1 on error.